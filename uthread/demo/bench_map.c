@@ -0,0 +1,178 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "include/uthread.h"
+
+#define KEY_COUNT (1 << 16)
+#define OPS_PER_THREAD (200000)
+#define MAX_THREADS (64)
+
+/* Compares uthread_map_t with an open addressing table guarded by a single
+ * uthread_mutex_t, the workload is 90% lookups, 9% inserts and 1% removals
+ * over KEY_COUNT keys. */
+
+struct locked_table_t {
+  struct uthread_mutex_t* plock;
+  uint64_t*               keys;
+  void**                  values;
+  uint64_t                mask;
+};
+
+struct bench_arg_t {
+  int                    use_map;
+  uint64_t               seed;
+  struct uthread_map_t*  pmap;
+  struct locked_table_t* ptable;
+};
+
+static atomic_int start_flag;
+
+static uint64_t next_random(uint64_t* pseed) {
+  *pseed ^= *pseed << 13;
+  *pseed ^= *pseed >> 7;
+  *pseed ^= *pseed << 17;
+  return *pseed;
+}
+
+static uint64_t table_index(const struct locked_table_t* ptable, uint64_t key) {
+  uint64_t i = (key * 0x9e3779b97f4a7c15ULL) & ptable->mask;
+  while (ptable->keys[i] != 0 && ptable->keys[i] != key) {
+    i = (i + 1) & ptable->mask;
+  }
+  return i;
+}
+
+static void table_put(struct locked_table_t* ptable, uint64_t key, void* pv) {
+  uthread_mutex_lock(ptable->plock);
+  uint64_t i         = table_index(ptable, key);
+  ptable->keys[i]    = key;
+  ptable->values[i]  = pv;
+  uthread_mutex_unlock(ptable->plock);
+}
+
+static void* table_get(struct locked_table_t* ptable, uint64_t key) {
+  uthread_mutex_lock(ptable->plock);
+  void* pv = ptable->values[table_index(ptable, key)];
+  uthread_mutex_unlock(ptable->plock);
+  return pv;
+}
+
+static void table_remove(struct locked_table_t* ptable, uint64_t key) {
+  uthread_mutex_lock(ptable->plock);
+  ptable->values[table_index(ptable, key)] = NULL;
+  uthread_mutex_unlock(ptable->plock);
+}
+
+void* BenchFunc(void* pParam) {
+  struct bench_arg_t* parg  = (struct bench_arg_t*)pParam;
+  uint64_t            found = 0;
+
+  while (!atomic_load(&start_flag)) {
+  }
+
+  for (int i = 0; i < OPS_PER_THREAD; i++) {
+    uint64_t r   = next_random(&parg->seed);
+    uint64_t key = 1 + (r >> 16) % KEY_COUNT;
+    uint32_t op  = r % 100;
+    void*    pv  = NULL;
+
+    if (parg->use_map) {
+      if (op < 90) {
+        found += UTHREAD_SUCCESS == uthread_map_get(parg->pmap, key, &pv);
+      } else if (op < 99) {
+        uthread_map_put(parg->pmap, key, (void*)key);
+      } else {
+        uthread_map_remove(parg->pmap, key);
+      }
+    } else {
+      if (op < 90) {
+        found += NULL != table_get(parg->ptable, key);
+      } else if (op < 99) {
+        table_put(parg->ptable, key, (void*)key);
+      } else {
+        table_remove(parg->ptable, key);
+      }
+    }
+  }
+
+  return (void*)found;
+}
+
+static double run(int use_map, int threads, struct uthread_map_t* pmap,
+                  struct locked_table_t* ptable) {
+  struct uthread_t*  phandles[MAX_THREADS];
+  struct bench_arg_t args[MAX_THREADS];
+  struct timespec    begin, end;
+
+  atomic_store(&start_flag, 0);
+  for (int t = 0; t < threads; t++) {
+    args[t].use_map = use_map;
+    args[t].seed    = 0x2545f4914f6cdd1dULL + t;
+    args[t].pmap    = pmap;
+    args[t].ptable  = ptable;
+    if (uthread_create(&phandles[t], NULL, (void*)BenchFunc, &args[t])) {
+      LOGE("Thread creation failed");
+      exit(UTHREAD_FAILURE);
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  atomic_store(&start_flag, 1);
+  for (int t = 0; t < threads; t++) {
+    uthread_join(phandles[t]);
+    uthread_release(phandles[t]);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds =
+      (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+  return (double)threads * OPS_PER_THREAD / seconds / 1e6;
+}
+
+int main() {
+  struct uthread_map_t* pmap = NULL;
+  struct locked_table_t table;
+  double                mops[2][7];
+  int                   counts[7] = {1, 2, 4, 8, 16, 32, 64};
+
+  if (uthread_map_init(&pmap, KEY_COUNT / 2)) {
+    LOGE("Map creation failed");
+    return UTHREAD_FAILURE;
+  }
+  table.mask   = 2 * KEY_COUNT - 1;
+  table.keys   = (uint64_t*)calloc(2 * KEY_COUNT, sizeof(uint64_t));
+  table.values = (void**)calloc(2 * KEY_COUNT, sizeof(void*));
+  if (NULL == table.keys || NULL == table.values ||
+      uthread_mutex_init(&table.plock)) {
+    LOGE("Table creation failed");
+    return UTHREAD_FAILURE;
+  }
+
+  // preload half of the keys
+  for (uint64_t key = 1; key <= KEY_COUNT; key += 2) {
+    uthread_map_put(pmap, key, (void*)key);
+    table_put(&table, key, (void*)key);
+  }
+
+  for (int i = 0; i < 7; i++) {
+    mops[0][i] = run(0, counts[i], pmap, &table);
+    mops[1][i] = run(1, counts[i], pmap, &table);
+  }
+
+  LOGI("threads  single-mutex(Mops/s)  uthread_map(Mops/s)");
+  for (int i = 0; i < 7; i++) {
+    LOGI("%7d  %20.2f  %19.2f", counts[i], mops[0][i], mops[1][i]);
+  }
+
+  uthread_map_deinit(pmap);
+  uthread_mutex_deinit(table.plock);
+  free(table.keys);
+  free(table.values);
+
+  return UTHREAD_SUCCESS;
+}
@@ -0,0 +1,74 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "include/uthread.h"
+
+#define THREAD_COUNT (256)
+#define ROUNDS (20)
+#define STACK_SIZE (256 * 1024)
+
+/* Compares the start-up latency of threads on stacks mapped by the system
+ * with threads on a prefaulted class of the stack pool, every round starts
+ * THREAD_COUNT threads that touch a few pages of their stack and joins
+ * them, so the pool hands the same stacks out again. */
+
+void* StackFunc(void* pParam) {
+  volatile uint8_t buffer[16 * 1024];
+  for (uint32_t i = 0; i < sizeof(buffer); i += 4096) {
+    buffer[i] = (uint8_t)i;
+  }
+  return NULL;
+}
+
+static double run(const struct uthread_attr_t* pattr) {
+  struct uthread_t* phandles[THREAD_COUNT];
+  struct timespec   begin, end;
+
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int t = 0; t < THREAD_COUNT; t++) {
+      if (uthread_create(&phandles[t], pattr, (void*)StackFunc, NULL)) {
+        LOGE("Thread creation failed");
+        exit(UTHREAD_FAILURE);
+      }
+    }
+    for (int t = 0; t < THREAD_COUNT; t++) {
+      uthread_join(phandles[t]);
+      uthread_release(phandles[t]);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds =
+      (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+  return seconds * 1e6 / (ROUNDS * THREAD_COUNT);
+}
+
+int main() {
+  struct uthread_stack_attr_t  stack_attr = {STACK_SIZE, THREAD_COUNT,
+                                             UTHREAD_STACK_PREFAULT, 0};
+  struct uthread_attr_t        system     = {UTHREAD_SCHED_INHERIT, 0, 0};
+  struct uthread_attr_t        pooled     = {UTHREAD_SCHED_INHERIT, 0, 1};
+  struct uthread_stack_stats_t stats;
+
+  if (uthread_stack_pool_init(1, &stack_attr)) {
+    LOGE("Stack pool creation failed");
+    return UTHREAD_FAILURE;
+  }
+
+  double system_us = run(&system);
+  double pooled_us = run(&pooled);
+
+  uthread_stack_pool_stats_get(1, &stats);
+  LOGI("system stacks: %.2f us per thread", system_us);
+  LOGI("pooled stacks: %.2f us per thread (%u stacks of %lu bytes, %u idle)",
+       pooled_us, stats.allocated, stats.size, stats.idle);
+
+  uthread_stack_pool_deinit(1);
+
+  return UTHREAD_SUCCESS;
+}
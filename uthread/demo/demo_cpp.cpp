@@ -0,0 +1,64 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include <array>
+#include <vector>
+
+#include "include/uthread.hpp"
+
+#define THREAD_COUNT (4)
+#define INCREMENTS (10000)
+
+int main() {
+  uthread::mutex              lock;
+  uthread::condition_variable ready;
+  int64_t                     total = 0;
+  bool                        go    = false;
+
+  // small lambdas are stored inside the thread handle
+  std::vector<uthread::thread> workers;
+  for (int t = 0; t < THREAD_COUNT; t++) {
+    workers.push_back(uthread::launch([&lock, &ready, &total, &go] {
+      {
+        uthread::lock_guard guard(lock);
+        ready.wait(guard, [&go] { return go; });
+      }
+      for (int i = 0; i < INCREMENTS; i++) {
+        uthread::lock_guard guard(lock);
+        total++;
+      }
+    }));
+  }
+
+  // a lambda capturing a large array by value is moved to the heap
+  std::array<int64_t, 32> values;
+  for (size_t i = 0; i < values.size(); i++) {
+    values[i] = (int64_t)i;
+  }
+  int64_t         sum = 0;
+  uthread::thread summer([values, &sum] {
+    for (size_t i = 0; i < values.size(); i++) {
+      sum += values[i];
+    }
+  });
+  LOGI("The summing thread with ID=0x%lx is running", summer.id());
+  summer.join();
+  LOGI("The sum of the array is: %ld", sum);
+
+  {
+    uthread::lock_guard guard(lock);
+    go = true;
+  }
+  // uthread_cond_signal wakes one waiter, so signal once per worker
+  for (int t = 0; t < THREAD_COUNT; t++) {
+    ready.notify_one();
+  }
+
+  // threads are joined when they go out of scope, or explicitly
+  for (size_t t = 0; t < workers.size(); t++) {
+    workers[t].join();
+  }
+  LOGI("The total is: %ld, expected: %d", total, THREAD_COUNT * INCREMENTS);
+
+  return UTHREAD_SUCCESS;
+}
@@ -0,0 +1,111 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "include/uthread.h"
+
+#define ITEM_COUNT (1000)
+
+struct record_t {
+  char     text[16];
+  int64_t  value;
+};
+
+struct sink_t {
+  struct uthread_arena_t* parena;
+  int64_t                 sum;
+};
+
+// stage 1: parse the text of each record into a number
+uint32_t ParseStage(void* const* ppin, uint32_t count, void** ppout,
+                    void* parg) {
+  for (uint32_t i = 0; i < count; i++) {
+    struct record_t* precord = (struct record_t*)ppin[i];
+    precord->value           = strtoll(precord->text, NULL, 10);
+    ppout[i]                 = precord;
+  }
+  return count;
+}
+
+// stage 2: transform the number, the slowest stage so it gets more workers
+uint32_t TransformStage(void* const* ppin, uint32_t count, void** ppout,
+                        void* parg) {
+  for (uint32_t i = 0; i < count; i++) {
+    struct record_t* precord = (struct record_t*)ppin[i];
+    precord->value           = precord->value * precord->value;
+    ppout[i]                 = precord;
+  }
+  // simulate some heavy work per batch
+  uthread_sleep(1);
+  return count;
+}
+
+// stage 3: write the result out and hand the record back to the arena
+uint32_t WriteStage(void* const* ppin, uint32_t count, void** ppout,
+                    void* parg) {
+  struct sink_t* psink = (struct sink_t*)parg;
+  for (uint32_t i = 0; i < count; i++) {
+    struct record_t* precord = (struct record_t*)ppin[i];
+    psink->sum += precord->value;
+    uthread_arena_free(psink->parena, precord);
+  }
+  return 0;
+}
+
+int main() {
+  int                        ret       = 0;
+  struct sink_t              sink      = {NULL, 0};
+  struct uthread_pipeline_t* ppipeline = NULL;
+
+  struct uthread_stage_attr_t stages[3] = {
+      {ParseStage, NULL, 1, 16, 64},
+      {TransformStage, NULL, 4, 8, 32},
+      {WriteStage, &sink, 1, 32, 64},
+  };
+
+  // records are allocated here and freed by the writer thread
+  ret = uthread_arena_init(&sink.parena);
+  if (ret) {
+    LOGE("Arena creation failed");
+    return UTHREAD_FAILURE;
+  }
+
+  ret = uthread_pipeline_init(&ppipeline, stages, 3);
+  if (ret) {
+    LOGE("Pipeline creation failed");
+    return UTHREAD_FAILURE;
+  }
+
+  for (int i = 0; i < ITEM_COUNT; i++) {
+    struct record_t* precord = NULL;
+    ret = uthread_arena_alloc(sink.parena, sizeof(struct record_t),
+                              (void**)&precord);
+    if (ret) {
+      LOGE("Record allocation failed");
+      break;
+    }
+    snprintf(precord->text, sizeof(precord->text), "%d", i);
+    uthread_pipeline_push(ppipeline, precord);
+  }
+
+  ret = uthread_pipeline_finish(ppipeline);
+  if (ret) {
+    LOGE("Pipeline finish failed");
+    return UTHREAD_FAILURE;
+  }
+
+  for (uint32_t s = 0; s < 3; s++) {
+    struct uthread_stage_stats_t stats;
+    uthread_pipeline_stats_get(ppipeline, s, &stats);
+    LOGI("Stage %u: workers=%u in=%lu out=%lu batches=%lu full_waits=%lu "
+         "depth=%u/%u",
+         s, stats.parallelism, stats.items_in, stats.items_out, stats.batches,
+         stats.full_waits, stats.queue_depth, stats.queue_capacity);
+  }
+  LOGI("The sum of squares is: %ld", sink.sum);
+
+  uthread_pipeline_deinit(ppipeline);
+  uthread_arena_deinit(sink.parena);
+
+  return UTHREAD_SUCCESS;
+}
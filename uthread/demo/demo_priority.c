@@ -0,0 +1,90 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "include/uthread.h"
+
+/* A real-time thread shares two locks with the main thread: one with
+ * priority inheritance and one with a priority ceiling. Without CAP_SYS_NICE
+ * the real-time policy is refused and the demo carries on with the default
+ * policy instead. */
+
+struct shared_t {
+  struct uthread_mutex_t* pinherit;
+  struct uthread_mutex_t* pprotect;
+  int64_t                 value;
+};
+
+void* RealtimeFunc(void* pParam) {
+  struct shared_t* pshared  = (struct shared_t*)pParam;
+  int32_t          policy   = 0;
+  int32_t          priority = 0;
+
+  uthread_priority_get(NULL, &policy, &priority);
+  LOGI("The worker runs with policy %d and priority %d", policy, priority);
+
+  uthread_mutex_lock(pshared->pinherit);
+  pshared->value++;
+  uthread_mutex_unlock(pshared->pinherit);
+
+  // only a real-time thread may lock the priority ceiling mutex on Linux
+  if (UTHREAD_SCHED_FIFO == policy || UTHREAD_SCHED_RR == policy) {
+    if (UTHREAD_SUCCESS == uthread_mutex_lock(pshared->pprotect)) {
+      pshared->value++;
+      uthread_mutex_unlock(pshared->pprotect);
+    }
+  }
+
+  return NULL;
+}
+
+int main() {
+  int                         ret     = 0;
+  struct uthread_t*           phandle = NULL;
+  struct shared_t             shared  = {NULL, NULL, 0};
+  struct uthread_mutex_attr_t inherit = {UTHREAD_MUTEX_PRIO_INHERIT, 0};
+  struct uthread_mutex_attr_t protect = {UTHREAD_MUTEX_PRIO_PROTECT, 20};
+  struct uthread_attr_t       fifo    = {UTHREAD_SCHED_FIFO, 10, 0};
+
+  ret = uthread_mutex_init_ex(&shared.pinherit, &inherit);
+  if (ret) {
+    LOGE("Priority inheritance mutex creation failed");
+    return UTHREAD_FAILURE;
+  }
+  ret = uthread_mutex_init_ex(&shared.pprotect, &protect);
+  if (ret) {
+    LOGE("Priority ceiling mutex creation failed");
+    return UTHREAD_FAILURE;
+  }
+
+  ret = uthread_create(&phandle, &fifo, (void*)RealtimeFunc, &shared);
+  if (UTHREAD_NO_PERMISSION == ret) {
+    LOGI("SCHED_FIFO is not permitted, starting the worker without it");
+    ret = uthread_create(&phandle, NULL, (void*)RealtimeFunc, &shared);
+  }
+  if (ret) {
+    LOGE("Thread creation failed");
+    return UTHREAD_FAILURE;
+  }
+
+  uthread_mutex_lock(shared.pinherit);
+  shared.value++;
+  uthread_mutex_unlock(shared.pinherit);
+
+  uthread_join(phandle);
+  uthread_release(phandle);
+  LOGI("The shared value is: %ld", shared.value);
+
+  // raise the main thread for a moment, then drop back to the default policy
+  ret = uthread_priority_set(NULL, UTHREAD_SCHED_RR, 5);
+  if (UTHREAD_NO_PERMISSION == ret) {
+    LOGI("SCHED_RR is not permitted for the main thread");
+  } else if (UTHREAD_SUCCESS == ret) {
+    LOGI("The main thread switched to SCHED_RR");
+    uthread_priority_set(NULL, UTHREAD_SCHED_OTHER, 0);
+  }
+
+  uthread_mutex_deinit(shared.pprotect);
+  uthread_mutex_deinit(shared.pinherit);
+
+  return UTHREAD_SUCCESS;
+}
@@ -0,0 +1,231 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#include "include/uthread.h"
+
+#define THREAD_COUNT (64)
+#define KEYS_PER_THREAD (2048)
+#define ROUNDS (8)
+#define CHURN_THREADS (8)
+#define CHURN_PAIRS (1000000)
+#define CHURN_RSS_LIMIT_KB (32 * 1024)
+
+/* Checks uthread_map_t under contention: every writer owns a range of keys
+ * and tracks what it stored, so all of its lookups and the final contents
+ * can be verified. The map starts at its minimum size and is resized many
+ * times while the writers run, and readers look up keys of other writers,
+ * which must map to the value encoded for the key or be absent.
+ *
+ * A second map is then churned with put/remove pairs of fresh keys, so it
+ * stays nearly empty but keeps retiring tables full of removed entries, and
+ * its memory use must stay bounded. */
+
+struct stress_arg_t {
+  struct uthread_map_t* pmap;
+  uint64_t              first;
+  uint64_t              seed;
+  uint8_t               present[KEYS_PER_THREAD];
+};
+
+static atomic_uint_fast64_t errors;
+
+static uint64_t next_random(uint64_t* pseed) {
+  *pseed ^= *pseed << 13;
+  *pseed ^= *pseed >> 7;
+  *pseed ^= *pseed << 17;
+  return *pseed;
+}
+
+// the value stored for key in round r, so readers can verify any hit
+static void* stress_value(uint64_t key, uint64_t r) {
+  return (void*)(key << 4 | r);
+}
+
+static int stress_value_valid(uint64_t key, void* pvalue) {
+  return ((uint64_t)pvalue >> 4) == key;
+}
+
+void* StressFunc(void* pParam) {
+  struct stress_arg_t* parg  = (struct stress_arg_t*)pParam;
+  void*                pv    = NULL;
+
+  for (uint64_t r = 0; r < ROUNDS; r++) {
+    for (uint64_t i = 0; i < KEYS_PER_THREAD; i++) {
+      uint64_t key = parg->first + i;
+      uint64_t op  = next_random(&parg->seed) % 4;
+
+      if (op < 3) {
+        uthread_map_put(parg->pmap, key, stress_value(key, r));
+        parg->present[i] = (uint8_t)(r + 1);
+      } else {
+        int32_t ret = uthread_map_remove(parg->pmap, key);
+        if ((UTHREAD_SUCCESS == ret) != (0 != parg->present[i])) {
+          LOGE("Remove of key %lu returned %d", key, ret);
+          atomic_fetch_add(&errors, 1);
+        }
+        parg->present[i] = 0;
+      }
+
+      // read back an own key and a key of another writer
+      uint64_t j   = next_random(&parg->seed) % KEYS_PER_THREAD;
+      int32_t  ret = uthread_map_get(parg->pmap, parg->first + j, &pv);
+      if (parg->present[j]) {
+        if (UTHREAD_SUCCESS != ret ||
+            pv != stress_value(parg->first + j, parg->present[j] - 1)) {
+          LOGE("Key %lu is lost or stale", parg->first + j);
+          atomic_fetch_add(&errors, 1);
+        }
+      } else if (UTHREAD_NOT_FOUND != ret) {
+        LOGE("Removed key %lu is still found", parg->first + j);
+        atomic_fetch_add(&errors, 1);
+      }
+
+      uint64_t other = 1 + next_random(&parg->seed) %
+                               (THREAD_COUNT * KEYS_PER_THREAD);
+      if (UTHREAD_SUCCESS == uthread_map_get(parg->pmap, other, &pv) &&
+          !stress_value_valid(other, pv)) {
+        LOGE("Key %lu maps to a value of another key", other);
+        atomic_fetch_add(&errors, 1);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+// put, read back and remove a new key over and over
+void* ChurnFunc(void* pParam) {
+  struct stress_arg_t* parg = (struct stress_arg_t*)pParam;
+  void*                pv   = NULL;
+
+  for (uint64_t i = 0; i < CHURN_PAIRS; i++) {
+    uint64_t key = parg->first + i;
+    uthread_map_put(parg->pmap, key, stress_value(key, 0));
+    if (UTHREAD_SUCCESS != uthread_map_get(parg->pmap, key, &pv) ||
+        pv != stress_value(key, 0)) {
+      LOGE("Churned key %lu is lost or stale", key);
+      atomic_fetch_add(&errors, 1);
+    }
+    if (UTHREAD_SUCCESS != uthread_map_remove(parg->pmap, key)) {
+      LOGE("Remove of churned key %lu failed", key);
+      atomic_fetch_add(&errors, 1);
+    }
+  }
+
+  return NULL;
+}
+
+static long max_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static void churn(struct stress_arg_t* args) {
+  struct uthread_map_t* pmap = NULL;
+  struct uthread_t*     phandles[CHURN_THREADS];
+  long                  rss = max_rss_kb();
+
+  if (uthread_map_init(&pmap, 1)) {
+    LOGE("Map creation failed");
+    atomic_fetch_add(&errors, 1);
+    return;
+  }
+
+  for (int t = 0; t < CHURN_THREADS; t++) {
+    args[t].pmap  = pmap;
+    args[t].first = 1 + (uint64_t)t * CHURN_PAIRS;
+    if (uthread_create(&phandles[t], NULL, (void*)ChurnFunc, &args[t])) {
+      LOGE("Thread creation failed");
+      atomic_fetch_add(&errors, 1);
+      return;
+    }
+  }
+  for (int t = 0; t < CHURN_THREADS; t++) {
+    uthread_join(phandles[t]);
+    uthread_release(phandles[t]);
+  }
+
+  uint64_t size = 0;
+  uthread_map_size(pmap, &size);
+  if (0 != size) {
+    LOGE("Churned map size is %lu, expected 0", size);
+    atomic_fetch_add(&errors, 1);
+  }
+  uthread_map_deinit(pmap);
+
+  rss = max_rss_kb() - rss;
+  if (rss > CHURN_RSS_LIMIT_KB) {
+    LOGE("Churning the map grew the peak RSS by %ld KB", rss);
+    atomic_fetch_add(&errors, 1);
+  }
+}
+
+int main() {
+  struct uthread_map_t* pmap = NULL;
+  struct uthread_t*     phandles[THREAD_COUNT];
+  struct stress_arg_t*  args =
+      (struct stress_arg_t*)calloc(THREAD_COUNT, sizeof(struct stress_arg_t));
+
+  if (NULL == args || uthread_map_init(&pmap, 1)) {
+    LOGE("Map creation failed");
+    return UTHREAD_FAILURE;
+  }
+
+  for (int t = 0; t < THREAD_COUNT; t++) {
+    args[t].pmap  = pmap;
+    args[t].first = 1 + (uint64_t)t * KEYS_PER_THREAD;
+    args[t].seed  = 0x9e3779b97f4a7c15ULL + t;
+    if (uthread_create(&phandles[t], NULL, (void*)StressFunc, &args[t])) {
+      LOGE("Thread creation failed");
+      return UTHREAD_FAILURE;
+    }
+  }
+  for (int t = 0; t < THREAD_COUNT; t++) {
+    uthread_join(phandles[t]);
+    uthread_release(phandles[t]);
+  }
+
+  // every key must hold exactly what its writer stored last
+  uint64_t expected = 0;
+  for (int t = 0; t < THREAD_COUNT; t++) {
+    for (uint64_t i = 0; i < KEYS_PER_THREAD; i++) {
+      uint64_t key = args[t].first + i;
+      void*    pv  = NULL;
+      int32_t  ret = uthread_map_get(pmap, key, &pv);
+      if (args[t].present[i]) {
+        expected++;
+        if (UTHREAD_SUCCESS != ret ||
+            pv != stress_value(key, args[t].present[i] - 1)) {
+          LOGE("Key %lu is lost or stale after the run", key);
+          atomic_fetch_add(&errors, 1);
+        }
+      } else if (UTHREAD_NOT_FOUND != ret) {
+        LOGE("Removed key %lu is found after the run", key);
+        atomic_fetch_add(&errors, 1);
+      }
+    }
+  }
+
+  uint64_t size = 0;
+  uthread_map_size(pmap, &size);
+  if (size != expected) {
+    LOGE("Map size is %lu, expected %lu", size, expected);
+    atomic_fetch_add(&errors, 1);
+  }
+
+  uthread_map_deinit(pmap);
+
+  churn(args);
+  free(args);
+
+  if (atomic_load(&errors)) {
+    LOGE("Map stress check failed with %lu errors", atomic_load(&errors));
+    return UTHREAD_FAILURE;
+  }
+  LOGI("Map stress check passed with %lu entries", expected);
+  return UTHREAD_SUCCESS;
+}
@@ -36,6 +36,33 @@
 
 #define UTHREAD_SUCCESS (0)
 #define UTHREAD_FAILURE (1)
+#define UTHREAD_NOT_FOUND (2)
+#define UTHREAD_NO_PERMISSION (3)
+
+// Size and alignment of the argument storage inside a thread handle
+#define UTHREAD_INLINE_SIZE (64)
+#define UTHREAD_INLINE_ALIGN (16)
+
+// Scheduling policies of a thread
+#define UTHREAD_SCHED_INHERIT (0)  // same as the creating thread
+#define UTHREAD_SCHED_OTHER (1)    // default time-sharing policy
+#define UTHREAD_SCHED_FIFO (2)     // real-time first-in first-out
+#define UTHREAD_SCHED_RR (3)       // real-time round-robin
+
+// Number of stack classes of the stack pool, numbered from 1
+#define UTHREAD_STACK_CLASS_COUNT (8)
+
+// Flags of a stack class
+#define UTHREAD_STACK_PREFAULT (1)  // fault every page in when mapped
+#define UTHREAD_STACK_HUGEPAGE (2)  // back with transparent huge pages
+#define UTHREAD_STACK_NUMA (4)      // bind the memory to numa_node
+
+// Kinds of mutex
+#define UTHREAD_MUTEX_DEFAULT (0)       // no priority protocol
+#define UTHREAD_MUTEX_PRIO_INHERIT (1)  // owner inherits the waiter priority
+/* owner runs at the priority ceiling, on Linux it can only be locked by
+ * threads of a real-time policy */
+#define UTHREAD_MUTEX_PRIO_PROTECT (2)
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,21 +71,102 @@ extern "C" {
 struct uthread_t;
 struct uthread_mutex_t;
 struct uthread_cond_t;
+struct uthread_pipeline_t;
+struct uthread_map_t;
+struct uthread_arena_t;
+struct uthread_counter_t;
+
+// Attributes of a thread, passed as pattr to uthread_create
+struct uthread_attr_t {
+  int32_t policy;    // UTHREAD_SCHED_*, zero inherits the creator's settings
+  int32_t priority;  // 0 for UTHREAD_SCHED_OTHER, 1-99 for the real-time ones
+  /* zero lets the system allocate the stack, otherwise a class of the pool,
+   * such a thread must return and be joined, uthread_close refuses it */
+  int32_t stack_class;
+};
+
+// Attributes of a class of the stack pool
+struct uthread_stack_attr_t {
+  uint64_t size;       // usable bytes, rounded up to whole (huge) pages
+  uint32_t count;      // number of stacks to preallocate
+  uint32_t flags;      // UTHREAD_STACK_*
+  int32_t  numa_node;  // node of UTHREAD_STACK_NUMA
+};
+
+// Usage of a class of the stack pool
+struct uthread_stack_stats_t {
+  uint64_t size;       // usable bytes of each stack
+  uint32_t allocated;  // stacks mapped, preallocated or added on demand
+  uint32_t idle;       // stacks waiting for a thread
+};
+
+// Attributes of a mutex
+struct uthread_mutex_attr_t {
+  int32_t kind;     // UTHREAD_MUTEX_*
+  int32_t ceiling;  // priority ceiling of UTHREAD_MUTEX_PRIO_PROTECT
+};
+
+/* Stage function of a pipeline: processes a batch of count input items and
+ * writes the items handed to the next stage into ppout, returns how many of
+ * them were written (at most count, items not forwarded are dropped). The
+ * output of the last stage is discarded. */
+typedef uint32_t (*uthread_stage_func_t)(void* const* ppin, uint32_t count,
+                                         void** ppout, void* parg);
+
+// Configuration of one pipeline stage
+struct uthread_stage_attr_t {
+  uthread_stage_func_t func;         // stage function, must not be null
+  void*                arg;          // user argument passed to func
+  uint32_t             parallelism;  // number of worker threads, 0 means 1
+  uint32_t             batch_size;   // max items per call of func, 0 means 1
+  uint32_t queue_capacity;  // capacity of the stage input queue, 0 means 64
+};
+
+// Counters of one pipeline stage
+struct uthread_stage_stats_t {
+  uint64_t items_in;        // items taken from the input queue
+  uint64_t items_out;       // items handed to the next stage
+  uint64_t batches;         // calls of the stage function
+  uint64_t full_waits;      // times a producer blocked on the full queue
+  uint32_t queue_depth;     // items currently waiting in the input queue
+  uint32_t queue_capacity;  // capacity of the input queue
+  uint32_t parallelism;     // number of worker threads
+};
 
-// Create a new thread
-PUBLIC int32_t uthread_create(struct uthread_t** pphandle, const void* pattr,
+/* Create a new thread, pattr is null for the default attributes,
+ * returns UTHREAD_NO_PERMISSION if its real-time policy is not allowed */
+PUBLIC int32_t uthread_create(struct uthread_t**            pphandle,
+                              const struct uthread_attr_t* pattr,
                               const void* pfunc, const void* parg);
+// Allocate a thread handle with inline storage for the thread argument
+PUBLIC int32_t uthread_prepare(struct uthread_t** pphandle, void** ppstorage);
+// Start a prepared thread, pfunc receives the inline storage as argument
+PUBLIC int32_t uthread_start(const struct uthread_t*      phandle,
+                             const struct uthread_attr_t* pattr,
+                             const void*                  pfunc);
 // Wait for the thread to finish
 PUBLIC int32_t uthread_join(const struct uthread_t* phandle);
-// Exit the current thread
+// Exit the current thread, refused for a thread on a pool stack not joined yet
 PUBLIC int32_t uthread_close(const struct uthread_t* phandle);
+// Release the handle of a joined or never started thread without exiting
+PUBLIC int32_t uthread_release(const struct uthread_t* phandle);
 // Get the thread ID
 PUBLIC int32_t uthread_id_get(const struct uthread_t* phandle,
                               uint64_t*               thread_id);
+/* Set the scheduling policy and priority, a null handle means the caller,
+ * returns UTHREAD_NO_PERMISSION if a real-time policy is not allowed */
+PUBLIC int32_t uthread_priority_set(const struct uthread_t* phandle,
+                                    int32_t policy, int32_t priority);
+// Get the scheduling policy and priority, a null handle means the caller
+PUBLIC int32_t uthread_priority_get(const struct uthread_t* phandle,
+                                    int32_t* ppolicy, int32_t* ppriority);
 // Sleep for specified time in microseconds
 PUBLIC int32_t uthread_sleep(uint64_t microseconds);
 // Initialize mutex
 PUBLIC int32_t uthread_mutex_init(struct uthread_mutex_t** ppmutex);
+// Initialize mutex of the given kind
+PUBLIC int32_t uthread_mutex_init_ex(struct uthread_mutex_t**           ppmutex,
+                                     const struct uthread_mutex_attr_t* pattr);
 // Deinitialize mutex
 PUBLIC int32_t uthread_mutex_deinit(const struct uthread_mutex_t* pmutex);
 // Lock mutex
@@ -74,6 +182,71 @@ PUBLIC int32_t uthread_cond_wait(const struct uthread_cond_t*  pcond,
                                  const struct uthread_mutex_t* pmutex);
 // Signal one waiting thread
 PUBLIC int32_t uthread_cond_signal(const struct uthread_cond_t* pcond);
+// Initialize pipeline and start the worker threads of all stages
+PUBLIC int32_t uthread_pipeline_init(
+    struct uthread_pipeline_t**        pppipeline,
+    const struct uthread_stage_attr_t* pstages, uint32_t count);
+// Deinitialize pipeline, finishing it first if needed
+PUBLIC int32_t uthread_pipeline_deinit(
+    const struct uthread_pipeline_t* ppipeline);
+// Feed one item into the first stage, blocks while its queue is full
+PUBLIC int32_t uthread_pipeline_push(const struct uthread_pipeline_t* ppipeline,
+                                     void*                            pitem);
+// Close the input, wait for all stages to drain and join the workers
+PUBLIC int32_t uthread_pipeline_finish(
+    const struct uthread_pipeline_t* ppipeline);
+// Get the counters of one stage
+PUBLIC int32_t uthread_pipeline_stats_get(
+    const struct uthread_pipeline_t* ppipeline, uint32_t index,
+    struct uthread_stage_stats_t* pstats);
+// Preallocate a class of guard-paged thread stacks for uthread_attr_t
+PUBLIC int32_t uthread_stack_pool_init(
+    int32_t stack_class, const struct uthread_stack_attr_t* pattr);
+// Unmap the stacks of a class, fails while any of them is in use
+PUBLIC int32_t uthread_stack_pool_deinit(int32_t stack_class);
+// Get the usage of a class of the stack pool
+PUBLIC int32_t uthread_stack_pool_stats_get(
+    int32_t stack_class, struct uthread_stack_stats_t* pstats);
+// Initialize concurrent hash map sized for capacity entries, it grows as needed
+PUBLIC int32_t uthread_map_init(struct uthread_map_t** ppmap,
+                                uint64_t               capacity);
+// Deinitialize concurrent hash map
+PUBLIC int32_t uthread_map_deinit(const struct uthread_map_t* pmap);
+// Insert or replace the value of key, keys 0 and UINT64_MAX are reserved
+PUBLIC int32_t uthread_map_put(const struct uthread_map_t* pmap, uint64_t key,
+                               void* pvalue);
+// Look up key without locking, returns UTHREAD_NOT_FOUND if it is absent
+PUBLIC int32_t uthread_map_get(const struct uthread_map_t* pmap, uint64_t key,
+                               void** ppvalue);
+// Remove key, returns UTHREAD_NOT_FOUND if it is absent
+PUBLIC int32_t uthread_map_remove(const struct uthread_map_t* pmap,
+                                  uint64_t                    key);
+// Get the number of entries
+PUBLIC int32_t uthread_map_size(const struct uthread_map_t* pmap,
+                                uint64_t*                   psize);
+// Initialize arena allocator with a cache per thread
+PUBLIC int32_t uthread_arena_init(struct uthread_arena_t** pparena);
+// Deinitialize arena allocator, no other thread may use it any more
+PUBLIC int32_t uthread_arena_deinit(const struct uthread_arena_t* parena);
+// Allocate a 16-byte aligned block, sizes up to 2048 bytes skip malloc
+PUBLIC int32_t uthread_arena_alloc(const struct uthread_arena_t* parena,
+                                   uint64_t size, void** ppmem);
+// Free a block, it may have been allocated by any other thread
+PUBLIC int32_t uthread_arena_free(const struct uthread_arena_t* parena,
+                                  void*                         pmem);
+/* Release every block of the arena at once, keeping its memory for reuse,
+ * no other thread may use the arena during the reset */
+PUBLIC int32_t uthread_arena_reset(const struct uthread_arena_t* parena);
+// Initialize counter sharded per cpu
+PUBLIC int32_t uthread_counter_init(struct uthread_counter_t** ppcounter);
+// Deinitialize counter
+PUBLIC int32_t uthread_counter_deinit(const struct uthread_counter_t* pcounter);
+// Add delta to the slot of the current cpu (rseq) or thread
+PUBLIC int32_t uthread_counter_add(const struct uthread_counter_t* pcounter,
+                                   int64_t                         delta);
+// Get the sum of all slots
+PUBLIC int32_t uthread_counter_get(const struct uthread_counter_t* pcounter,
+                                   int64_t*                        pvalue);
 // get the version number
 PUBLIC const uint8_t* uthread_version();
 #ifdef __cplusplus
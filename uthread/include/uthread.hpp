@@ -0,0 +1,263 @@
+#ifndef __UTHREAD_HPP_
+#define __UTHREAD_HPP_
+
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "uthread.h"
+
+/* C++11 interface on top of the C API: move-only threads that run any
+ * callable, and RAII wrappers for mutex and condition variable. A callable
+ * that fits into UTHREAD_INLINE_SIZE bytes is stored inside the thread
+ * handle, larger ones are moved to the heap. */
+
+namespace uthread {
+
+namespace detail {
+
+// whether a callable of type Fn can live in the storage of a thread handle
+template <typename Fn>
+struct fits_inline
+    : std::integral_constant<bool, sizeof(Fn) <= UTHREAD_INLINE_SIZE &&
+                                       alignof(Fn) <= UTHREAD_INLINE_ALIGN> {};
+
+// an exception escaping the callable terminates the program like std::thread
+template <typename Fn>
+void* entry_inline(void* pstorage) noexcept {
+  Fn* pfn = static_cast<Fn*>(pstorage);
+  (*pfn)();
+  pfn->~Fn();
+  return nullptr;
+}
+
+template <typename Fn>
+void* entry_heap(void* pstorage) noexcept {
+  Fn* pfn = *static_cast<Fn**>(pstorage);
+  (*pfn)();
+  delete pfn;
+  return nullptr;
+}
+
+// construct the callable in the storage and return the matching entry
+template <typename Fn, typename F>
+const void* place(void* pstorage, F&& f, std::true_type) {
+  new (pstorage) Fn(std::forward<F>(f));
+  return reinterpret_cast<const void*>(&entry_inline<Fn>);
+}
+
+template <typename Fn, typename F>
+const void* place(void* pstorage, F&& f, std::false_type) {
+  *static_cast<Fn**>(pstorage) = new Fn(std::forward<F>(f));
+  return reinterpret_cast<const void*>(&entry_heap<Fn>);
+}
+
+// destroy a placed callable whose thread failed to start
+template <typename Fn>
+void discard(void* pstorage, std::true_type) {
+  static_cast<Fn*>(pstorage)->~Fn();
+}
+
+template <typename Fn>
+void discard(void* pstorage, std::false_type) {
+  delete *static_cast<Fn**>(pstorage);
+}
+
+}  // namespace detail
+
+// Move-only thread running a callable, joined on destruction if still running
+class thread {
+ public:
+  thread() noexcept : phandle_(nullptr) {}
+
+  template <typename F, typename = typename std::enable_if<!std::is_same<
+                            typename std::decay<F>::type, thread>::value>::type>
+  explicit thread(F&& f, const uthread_attr_t* pattr = nullptr)
+      : phandle_(nullptr) {
+    typedef typename std::decay<F>::type Fn;
+    typedef detail::fits_inline<Fn>      inline_t;
+
+    uthread_t* phandle  = nullptr;
+    void*      pstorage = nullptr;
+    if (UTHREAD_SUCCESS != uthread_prepare(&phandle, &pstorage)) {
+      throw std::bad_alloc();
+    }
+
+    const void* pentry = nullptr;
+    try {
+      pentry = detail::place<Fn>(pstorage, std::forward<F>(f), inline_t());
+    } catch (...) {
+      uthread_release(phandle);
+      throw;
+    }
+
+    if (UTHREAD_SUCCESS != uthread_start(phandle, pattr, pentry)) {
+      detail::discard<Fn>(pstorage, inline_t());
+      uthread_release(phandle);
+      throw std::runtime_error("uthread: failed to start the thread");
+    }
+    phandle_ = phandle;
+  }
+
+  thread(thread&& other) noexcept : phandle_(other.phandle_) {
+    other.phandle_ = nullptr;
+  }
+
+  thread& operator=(thread&& other) {
+    if (this != &other) {
+      if (joinable()) {
+        join();
+      }
+      phandle_       = other.phandle_;
+      other.phandle_ = nullptr;
+    }
+    return *this;
+  }
+
+  thread(const thread&)            = delete;
+  thread& operator=(const thread&) = delete;
+
+  ~thread() {
+    if (joinable()) {
+      uthread_join(phandle_);
+      uthread_release(phandle_);
+    }
+  }
+
+  bool joinable() const noexcept { return nullptr != phandle_; }
+
+  // Wait for the thread to finish and release its handle
+  void join() {
+    if (!joinable()) {
+      throw std::logic_error("uthread: the thread is not joinable");
+    }
+    if (UTHREAD_SUCCESS != uthread_join(phandle_)) {
+      throw std::runtime_error("uthread: failed to join the thread");
+    }
+    uthread_release(phandle_);
+    phandle_ = nullptr;
+  }
+
+  uint64_t id() const {
+    uint64_t thread_id = 0;
+    if (joinable()) {
+      uthread_id_get(phandle_, &thread_id);
+    }
+    return thread_id;
+  }
+
+  const uthread_t* native_handle() const noexcept { return phandle_; }
+
+  void swap(thread& other) noexcept { std::swap(phandle_, other.phandle_); }
+
+ private:
+  uthread_t* phandle_;
+};
+
+// Start a thread running f, pattr is forwarded to uthread_start
+template <typename F>
+thread launch(F&& f, const uthread_attr_t* pattr = nullptr) {
+  return thread(std::forward<F>(f), pattr);
+}
+
+// Owner of a uthread_mutex_t
+class mutex {
+ public:
+  mutex() : pmutex_(nullptr) {
+    if (UTHREAD_SUCCESS != uthread_mutex_init(&pmutex_)) {
+      throw std::runtime_error("uthread: failed to initialize the mutex");
+    }
+  }
+
+  explicit mutex(const uthread_mutex_attr_t& attr) : pmutex_(nullptr) {
+    if (UTHREAD_SUCCESS != uthread_mutex_init_ex(&pmutex_, &attr)) {
+      throw std::runtime_error("uthread: failed to initialize the mutex");
+    }
+  }
+
+  mutex(const mutex&)            = delete;
+  mutex& operator=(const mutex&) = delete;
+
+  ~mutex() { uthread_mutex_deinit(pmutex_); }
+
+  void lock() {
+    if (UTHREAD_SUCCESS != uthread_mutex_lock(pmutex_)) {
+      throw std::runtime_error("uthread: failed to lock the mutex");
+    }
+  }
+
+  void unlock() { uthread_mutex_unlock(pmutex_); }
+
+  const uthread_mutex_t* native_handle() const noexcept { return pmutex_; }
+
+ private:
+  uthread_mutex_t* pmutex_;
+};
+
+// Holds a uthread_mutex_t locked for the lifetime of the guard
+class lock_guard {
+ public:
+  explicit lock_guard(mutex& m) : pmutex_(m.native_handle()) { lock(); }
+
+  explicit lock_guard(const uthread_mutex_t* pmutex) : pmutex_(pmutex) {
+    lock();
+  }
+
+  lock_guard(const lock_guard&)            = delete;
+  lock_guard& operator=(const lock_guard&) = delete;
+
+  ~lock_guard() { uthread_mutex_unlock(pmutex_); }
+
+  const uthread_mutex_t* native_handle() const noexcept { return pmutex_; }
+
+ private:
+  void lock() {
+    if (UTHREAD_SUCCESS != uthread_mutex_lock(pmutex_)) {
+      throw std::runtime_error("uthread: failed to lock the mutex");
+    }
+  }
+
+  const uthread_mutex_t* pmutex_;
+};
+
+// Owner of a uthread_cond_t, waits on the mutex held by a lock_guard
+class condition_variable {
+ public:
+  condition_variable() : pcond_(nullptr) {
+    if (UTHREAD_SUCCESS != uthread_cond_init(&pcond_)) {
+      throw std::runtime_error(
+          "uthread: failed to initialize the condition variable");
+    }
+  }
+
+  condition_variable(const condition_variable&)            = delete;
+  condition_variable& operator=(const condition_variable&) = delete;
+
+  ~condition_variable() { uthread_cond_deinit(pcond_); }
+
+  void wait(lock_guard& lock) {
+    if (UTHREAD_SUCCESS != uthread_cond_wait(pcond_, lock.native_handle())) {
+      throw std::runtime_error("uthread: failed to wait for the condition");
+    }
+  }
+
+  template <typename Predicate>
+  void wait(lock_guard& lock, Predicate pred) {
+    while (!pred()) {
+      wait(lock);
+    }
+  }
+
+  void notify_one() { uthread_cond_signal(pcond_); }
+
+  const uthread_cond_t* native_handle() const noexcept { return pcond_; }
+
+ private:
+  uthread_cond_t* pcond_;
+};
+
+}  // namespace uthread
+
+#endif  // __UTHREAD_HPP_
@@ -1,7 +1,13 @@
+#define _GNU_SOURCE
+
 #include "include/uthread.h"
 
+#include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #define RET_SUCCESS (0)
@@ -10,11 +16,14 @@
 typedef void* (*start_routine)(void*);
 
 struct uthread_t {
-  pthread_t       handle;
-  pthread_t       id;
-  start_routine   func;
-  pthread_attr_t* attr;
-  void*           arg;
+  pthread_t             handle;
+  pthread_t             id;
+  start_routine         func;
+  struct uthread_attr_t attr;
+  void*                 arg;
+  void*                 pstack;  // pool stack, returned when joined
+  // argument of a thread started by uthread_prepare and uthread_start
+  _Alignas(UTHREAD_INLINE_ALIGN) uint8_t storage[UTHREAD_INLINE_SIZE];
 };
 
 struct uthread_mutex_t {
@@ -25,46 +34,224 @@ struct uthread_cond_t {
   pthread_cond_t cv;
 };
 
-int32_t uthread_create(struct uthread_t** pphandle, const void* pattr,
+// stack pool of uthread_stack.c
+int32_t stack_pool_acquire(int32_t stack_class, void** ppstack,
+                           uint64_t* psize);
+void    stack_pool_return(int32_t stack_class, void* pstack);
+
+/* Handles, mutexes and condition variables are created and destroyed from
+ * different threads, so they come from an arena instead of malloc. */
+static struct uthread_arena_t* library_arena = NULL;
+static pthread_once_t          library_arena_once = PTHREAD_ONCE_INIT;
+
+static void library_arena_init(void) {
+  if (UTHREAD_SUCCESS != uthread_arena_init(&library_arena)) {
+    library_arena = NULL;
+  }
+}
+
+static void* library_alloc(size_t size) {
+  pthread_once(&library_arena_once, library_arena_init);
+  if (NULL == library_arena) {
+    return malloc(size);
+  }
+
+  void* pmem = NULL;
+  uthread_arena_alloc(library_arena, size, &pmem);
+  return pmem;
+}
+
+static void library_free(const void* pmem) {
+  if (NULL == library_arena) {
+    free((void*)pmem);
+    return;
+  }
+  uthread_arena_free(library_arena, (void*)pmem);
+}
+
+// map the uthread scheduling policy to the native one
+static int32_t sched_policy_to_native(int32_t policy, int* pnative) {
+  switch (policy) {
+    case UTHREAD_SCHED_OTHER:
+      *pnative = SCHED_OTHER;
+      return UTHREAD_SUCCESS;
+    case UTHREAD_SCHED_FIFO:
+      *pnative = SCHED_FIFO;
+      return UTHREAD_SUCCESS;
+    case UTHREAD_SCHED_RR:
+      *pnative = SCHED_RR;
+      return UTHREAD_SUCCESS;
+    default:
+      LOGE("Error: unknown scheduling policy %d!", policy);
+      return UTHREAD_FAILURE;
+  }
+}
+
+static int32_t sched_policy_from_native(int native) {
+  switch (native) {
+    case SCHED_FIFO:
+      return UTHREAD_SCHED_FIFO;
+    case SCHED_RR:
+      return UTHREAD_SCHED_RR;
+    default:
+      return UTHREAD_SCHED_OTHER;
+  }
+}
+
+// translate the uthread attributes into pthread attributes
+static int32_t thread_attr_build(const struct uthread_attr_t* pattr,
+                                 pthread_attr_t*              pthread_attr) {
+  int native = SCHED_OTHER;
+  if (UTHREAD_SCHED_INHERIT != pattr->policy &&
+      UTHREAD_SUCCESS != sched_policy_to_native(pattr->policy, &native)) {
+    return UTHREAD_FAILURE;
+  }
+
+  if (RET_SUCCESS != pthread_attr_init(pthread_attr)) {
+    LOGE("Error: failed to initialize thread attributes!");
+    return UTHREAD_FAILURE;
+  }
+
+  if (UTHREAD_SCHED_INHERIT != pattr->policy) {
+    struct sched_param param;
+    param.sched_priority = pattr->priority;
+    if (RET_SUCCESS != pthread_attr_setinheritsched(pthread_attr,
+                                                    PTHREAD_EXPLICIT_SCHED) ||
+        RET_SUCCESS != pthread_attr_setschedpolicy(pthread_attr, native) ||
+        RET_SUCCESS != pthread_attr_setschedparam(pthread_attr, &param)) {
+      LOGE("Error: invalid priority %d for scheduling policy %d!",
+           pattr->priority, pattr->policy);
+      pthread_attr_destroy(pthread_attr);
+      return UTHREAD_FAILURE;
+    }
+  }
+
+  return UTHREAD_SUCCESS;
+}
+
+// start the thread of a handle whose argument has been set
+static int32_t thread_start(struct uthread_t*            phandle,
+                            const struct uthread_attr_t* pattr,
+                            const void*                  pfunc) {
+  pthread_attr_t  attr;
+  pthread_attr_t* pthread_attr = NULL;
+  phandle->pstack              = NULL;
+  if (pattr) {
+    phandle->attr = *pattr;
+    if (UTHREAD_SUCCESS != thread_attr_build(&phandle->attr, &attr)) {
+      return UTHREAD_FAILURE;
+    }
+    pthread_attr = &attr;
+
+    if (0 != phandle->attr.stack_class) {
+      uint64_t size = 0;
+      if (UTHREAD_SUCCESS != stack_pool_acquire(phandle->attr.stack_class,
+                                                &phandle->pstack, &size)) {
+        pthread_attr_destroy(pthread_attr);
+        return UTHREAD_FAILURE;
+      }
+      if (RET_SUCCESS !=
+          pthread_attr_setstack(pthread_attr, phandle->pstack, size)) {
+        LOGE("Error: failed to set the stack of a thread!");
+        stack_pool_return(phandle->attr.stack_class, phandle->pstack);
+        phandle->pstack = NULL;
+        pthread_attr_destroy(pthread_attr);
+        return UTHREAD_FAILURE;
+      }
+    }
+  } else {
+    memset(&phandle->attr, 0, sizeof(struct uthread_attr_t));
+  }
+
+  phandle->func = (start_routine)pfunc;
+
+  int ret       = pthread_create(&phandle->handle, pthread_attr, phandle->func,
+                                 phandle->arg);
+  if (pthread_attr) {
+    pthread_attr_destroy(pthread_attr);
+  }
+  if (RET_SUCCESS != ret) {
+    if (EPERM == ret) {
+      LOGE("Error: no permission for the policy, CAP_SYS_NICE is needed!");
+    } else {
+      LOGE("Error: failed to create a thread!");
+    }
+    if (phandle->pstack) {
+      stack_pool_return(phandle->attr.stack_class, phandle->pstack);
+      phandle->pstack = NULL;
+    }
+    return EPERM == ret ? UTHREAD_NO_PERMISSION : UTHREAD_FAILURE;
+  }
+  phandle->id = phandle->handle;
+
+  LOGI("The thread with ID=0x%lx is created", phandle->handle);
+
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_create(struct uthread_t**            pphandle,
+                       const struct uthread_attr_t* pattr,
                        const void* pfunc, const void* parg) {
   if (NULL == pfunc) {
     LOGE("Error: thread function is not specified!");
     return UTHREAD_FAILURE;
   }
   struct uthread_t* phandle =
-      (struct uthread_t*)malloc(sizeof(struct uthread_t));
+      (struct uthread_t*)library_alloc(sizeof(struct uthread_t));
   if (NULL == phandle) {
     LOGE("Error: failed to allocate memory!");
     return UTHREAD_FAILURE;
   }
 
-  if (pattr) {
-    phandle->attr = (pthread_attr_t*)pattr;
-  } else {
-    phandle->attr = NULL;
+  phandle->arg = (void*)parg;
+  int32_t ret  = thread_start(phandle, pattr, pfunc);
+  if (UTHREAD_SUCCESS != ret) {
+    library_free(phandle);
+    phandle = NULL;
+    return ret;
   }
 
-  phandle->func = (start_routine)pfunc;
-  phandle->arg  = parg;
+  *pphandle = phandle;
+  return UTHREAD_SUCCESS;
+}
 
-  int ret       = pthread_create(&phandle->handle, phandle->attr, phandle->func,
-                                 phandle->arg);
-  if (RET_SUCCESS == ret) {
-    *pphandle   = (void*)phandle;
-    phandle->id = phandle->handle;
-  } else {
-    LOGE("Error: failed to create a thread!");
-    free(phandle);
-    phandle = NULL;
+int32_t uthread_prepare(struct uthread_t** pphandle, void** ppstorage) {
+  if (NULL == pphandle || NULL == ppstorage) {
+    LOGE("Error: please pass valid handle and storage pointers!");
     return UTHREAD_FAILURE;
   }
+  struct uthread_t* phandle =
+      (struct uthread_t*)library_alloc(sizeof(struct uthread_t));
+  if (NULL == phandle) {
+    LOGE("Error: failed to allocate memory!");
+    return UTHREAD_FAILURE;
+  }
+  memset(phandle, 0, sizeof(struct uthread_t));
 
-  LOGI("The thread with ID=0x%lx is created",
-       ((struct uthread_t*)(*pphandle))->handle);
+  // the thread function receives the storage inside the handle as argument
+  phandle->arg = phandle->storage;
 
+  *pphandle    = phandle;
+  *ppstorage   = phandle->storage;
   return UTHREAD_SUCCESS;
 }
 
+int32_t uthread_start(const struct uthread_t*      phandle,
+                      const struct uthread_attr_t* pattr,
+                      const void*                  pfunc) {
+  if (NULL == phandle) {
+    LOGE(
+        "Error: thread handle is null, please prepare a thread first!");
+    return UTHREAD_FAILURE;
+  }
+  if (NULL == pfunc) {
+    LOGE("Error: thread function is not specified!");
+    return UTHREAD_FAILURE;
+  }
+
+  return thread_start((struct uthread_t*)phandle, pattr, pfunc);
+}
+
 int32_t uthread_join(const struct uthread_t* phandle) {
   if (NULL == phandle) {
     LOGE(
@@ -72,13 +259,20 @@ int32_t uthread_join(const struct uthread_t* phandle) {
     return UTHREAD_FAILURE;
   }
 
-  int ret = pthread_join(((struct uthread_t*)phandle)->handle, NULL);
+  struct uthread_t* pthread = (struct uthread_t*)phandle;
+  int               ret     = pthread_join(pthread->handle, NULL);
 
   if (RET_SUCCESS != ret) {
     LOGE("Error: failed to join the thread!");
     return UTHREAD_FAILURE;
   }
 
+  // the thread is gone, so its stack can be handed to the next one
+  if (pthread->pstack) {
+    stack_pool_return(pthread->attr.stack_class, pthread->pstack);
+    pthread->pstack = NULL;
+  }
+
   return UTHREAD_SUCCESS;
 }
 
@@ -88,6 +282,11 @@ int32_t uthread_close(const struct uthread_t* phandle) {
         "Error: thread handle is null, please create a thread properly first!");
     return UTHREAD_FAILURE;
   }
+  // a pool stack only goes back to its class when the thread is joined
+  if (((struct uthread_t*)phandle)->pstack) {
+    LOGE("Error: the thread runs on a pool stack, join it instead!");
+    return UTHREAD_FAILURE;
+  }
 
   // store the handle for the purpose of invoking exiting function
   pthread_t handle = ((struct uthread_t*)phandle)->handle;
@@ -95,7 +294,7 @@ int32_t uthread_close(const struct uthread_t* phandle) {
        ((struct uthread_t*)phandle)->id);
 
   // dellocate memory
-  free(phandle);
+  library_free(phandle);
 
   // invoke exiting function of the thread
   pthread_exit(&handle);
@@ -103,6 +302,19 @@ int32_t uthread_close(const struct uthread_t* phandle) {
   return UTHREAD_SUCCESS;
 }
 
+int32_t uthread_release(const struct uthread_t* phandle) {
+  if (NULL == phandle) {
+    LOGE(
+        "Error: thread handle is null, please create a thread properly first!");
+    return UTHREAD_FAILURE;
+  }
+
+  // the thread has been joined, so only the handle itself is left to free
+  library_free(phandle);
+
+  return UTHREAD_SUCCESS;
+}
+
 int32_t uthread_id_get(const struct uthread_t* phandle, uint64_t* pthread_id) {
   if (NULL == phandle) {
     LOGE(
@@ -119,6 +331,57 @@ int32_t uthread_id_get(const struct uthread_t* phandle, uint64_t* pthread_id) {
   return UTHREAD_SUCCESS;
 }
 
+int32_t uthread_priority_set(const struct uthread_t* phandle, int32_t policy,
+                             int32_t priority) {
+  int native = SCHED_OTHER;
+  if (UTHREAD_SUCCESS != sched_policy_to_native(policy, &native)) {
+    return UTHREAD_FAILURE;
+  }
+
+  // a null handle stands for the calling thread
+  pthread_t thread =
+      phandle ? ((struct uthread_t*)phandle)->handle : pthread_self();
+  struct sched_param param;
+  param.sched_priority = priority;
+
+  int ret              = pthread_setschedparam(thread, native, &param);
+  if (EPERM == ret) {
+    LOGE("Error: no permission to set the priority, CAP_SYS_NICE is needed!");
+    return UTHREAD_NO_PERMISSION;
+  }
+  if (RET_SUCCESS != ret) {
+    LOGE("Error: invalid priority %d for scheduling policy %d!", priority,
+         policy);
+    return UTHREAD_FAILURE;
+  }
+
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_priority_get(const struct uthread_t* phandle,
+                             int32_t* ppolicy, int32_t* ppriority) {
+  if (NULL == ppolicy || NULL == ppriority) {
+    LOGE("Error: please pass valid policy and priority pointers!");
+    return UTHREAD_FAILURE;
+  }
+
+  pthread_t thread =
+      phandle ? ((struct uthread_t*)phandle)->handle : pthread_self();
+  struct sched_param param;
+  int                native = SCHED_OTHER;
+
+  int                ret    = pthread_getschedparam(thread, &native, &param);
+  if (RET_SUCCESS != ret) {
+    LOGE("Error: failed to get the thread priority!");
+    return UTHREAD_FAILURE;
+  }
+
+  *ppolicy   = sched_policy_from_native(native);
+  *ppriority = param.sched_priority;
+
+  return UTHREAD_SUCCESS;
+}
+
 int32_t uthread_sleep(uint64_t microseconds) {
   struct timespec ts;
   ts.tv_sec  = microseconds / 1000;
@@ -135,6 +398,50 @@ int32_t uthread_sleep(uint64_t microseconds) {
 }
 
 int32_t uthread_mutex_init(struct uthread_mutex_t** ppmutex) {
+  return uthread_mutex_init_ex(ppmutex, NULL);
+}
+
+// translate the uthread mutex attributes into pthread mutex attributes
+static int32_t mutex_attr_build(const struct uthread_mutex_attr_t* pattr,
+                                pthread_mutexattr_t* pmutex_attr) {
+  if (RET_SUCCESS != pthread_mutexattr_init(pmutex_attr)) {
+    LOGE("Error: Failed to initialize mutex attributes!");
+    return UTHREAD_FAILURE;
+  }
+
+  int ret = RET_SUCCESS;
+  switch (pattr->kind) {
+    case UTHREAD_MUTEX_DEFAULT:
+      break;
+    case UTHREAD_MUTEX_PRIO_INHERIT:
+      // the owner is boosted to the priority of the highest waiter (PI futex)
+      ret = pthread_mutexattr_setprotocol(pmutex_attr, PTHREAD_PRIO_INHERIT);
+      break;
+    case UTHREAD_MUTEX_PRIO_PROTECT:
+      // the owner runs at the ceiling priority while holding the lock
+      ret = pthread_mutexattr_setprotocol(pmutex_attr, PTHREAD_PRIO_PROTECT);
+      if (RET_SUCCESS == ret) {
+        ret = pthread_mutexattr_setprioceiling(pmutex_attr, pattr->ceiling);
+      }
+      break;
+    default:
+      LOGE("Error: unknown mutex kind %d!", pattr->kind);
+      pthread_mutexattr_destroy(pmutex_attr);
+      return UTHREAD_FAILURE;
+  }
+
+  if (RET_SUCCESS != ret) {
+    LOGE("Error: Mutex kind %d with ceiling %d is not supported!", pattr->kind,
+         pattr->ceiling);
+    pthread_mutexattr_destroy(pmutex_attr);
+    return UTHREAD_FAILURE;
+  }
+
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_mutex_init_ex(struct uthread_mutex_t**          ppmutex,
+                              const struct uthread_mutex_attr_t* pattr) {
   if (NULL == ppmutex) {
     LOGE("Error: Mutex pointer is null!");
     return UTHREAD_FAILURE;
@@ -142,17 +449,31 @@ int32_t uthread_mutex_init(struct uthread_mutex_t** ppmutex) {
 
   LOGI("sizeof(uthread_mutex_t): %d", sizeof(struct uthread_mutex_t));
   struct uthread_mutex_t* pmutex =
-      (struct uthread_mutex_t*)malloc(sizeof(struct uthread_mutex_t));
+      (struct uthread_mutex_t*)library_alloc(sizeof(struct uthread_mutex_t));
   if (NULL == pmutex) {
     LOGE("Error: Failed to allocate memory for mutex!");
     return UTHREAD_FAILURE;
   }
 
-  int ret = pthread_mutex_init(&pmutex->lock, NULL);
+  pthread_mutexattr_t  mutex_attr;
+  pthread_mutexattr_t* pmutex_attr = NULL;
+  if (pattr) {
+    if (UTHREAD_SUCCESS != mutex_attr_build(pattr, &mutex_attr)) {
+      library_free(pmutex);
+      pmutex = NULL;
+      return UTHREAD_FAILURE;
+    }
+    pmutex_attr = &mutex_attr;
+  }
+
+  int ret = pthread_mutex_init(&pmutex->lock, pmutex_attr);
+  if (pmutex_attr) {
+    pthread_mutexattr_destroy(pmutex_attr);
+  }
 
   if (RET_SUCCESS != ret) {
     LOGE("Error: Failed to initialize mutex!");
-    free(pmutex);
+    library_free(pmutex);
     pmutex = NULL;
     return UTHREAD_FAILURE;
   }
@@ -174,7 +495,7 @@ int32_t uthread_mutex_deinit(const struct uthread_mutex_t* pmutex) {
     return UTHREAD_FAILURE;
   }
 
-  free(pmutex);
+  library_free(pmutex);
   return UTHREAD_SUCCESS;
 }
 
@@ -216,7 +537,7 @@ int32_t uthread_cond_init(struct uthread_cond_t** ppcond) {
     return UTHREAD_FAILURE;
   }
   struct uthread_cond_t* pcv =
-      (struct uthread_cond_t*)malloc(sizeof(struct uthread_cond_t));
+      (struct uthread_cond_t*)library_alloc(sizeof(struct uthread_cond_t));
   if (NULL == pcv) {
     LOGE("Error: Failed to allocate memory for condition variable!");
     return UTHREAD_FAILURE;
@@ -226,7 +547,7 @@ int32_t uthread_cond_init(struct uthread_cond_t** ppcond) {
 
   if (RET_SUCCESS != ret) {
     LOGE("Error: Failed to initialize condition variable!");
-    free(pcv);
+    library_free(pcv);
     pcv = NULL;
     return UTHREAD_FAILURE;
   }
@@ -248,7 +569,7 @@ int32_t uthread_cond_deinit(const struct uthread_cond_t* pcond) {
     return UTHREAD_FAILURE;
   }
 
-  free(pcond);
+  library_free(pcond);
   return UTHREAD_SUCCESS;
 }
 
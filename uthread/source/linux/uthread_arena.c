@@ -0,0 +1,370 @@
+#include "include/uthread.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define RET_SUCCESS (0)
+#define RET_FAILURE (1)
+
+// size classes are 16, 32, ..., 2048 bytes, larger blocks come from malloc
+#define ARENA_MIN_SHIFT (4)
+#define ARENA_CLASS_COUNT (8)
+#define ARENA_MAX_SIZE (1 << (ARENA_MIN_SHIFT + ARENA_CLASS_COUNT - 1))
+#define ARENA_LARGE_CLASS (ARENA_CLASS_COUNT)
+
+#define ARENA_CHUNK_SIZE (256 * 1024)
+#define ARENA_ALIGN (16)
+
+struct arena_heap_t;
+
+// placed right in front of every block handed out
+struct arena_header_t {
+  struct arena_heap_t* pheap;
+  uint32_t             size_class;
+  uint32_t             reserved;
+};
+
+// links of a large block, placed in front of its header
+struct arena_large_t {
+  struct arena_large_t* pprev;
+  struct arena_large_t* pnext;
+};
+
+// a free block reuses its payload as the list link
+struct arena_block_t {
+  struct arena_block_t* pnext;
+};
+
+struct arena_chunk_t {
+  struct arena_chunk_t* pnext;
+};
+
+/* Per-thread cache of an arena. Only the owner thread touches the local free
+ * lists and the bump region, other threads hand blocks back through the
+ * remote lists which the owner drains when its local list runs empty. */
+struct arena_heap_t {
+  struct uthread_arena_t*        parena;
+  struct arena_block_t*          free_list[ARENA_CLASS_COUNT];
+  _Atomic(struct arena_block_t*) remote_list[ARENA_CLASS_COUNT];
+  char*                          bump;
+  char*                          bump_end;
+  struct arena_heap_t*           pnext;
+  uint32_t                       orphaned;
+};
+
+struct uthread_arena_t {
+  pthread_key_t         key;
+  pthread_mutex_t       lock;
+  struct arena_heap_t*  heaps;
+  struct arena_chunk_t* chunks;
+  struct arena_chunk_t* free_chunks;
+  struct arena_large_t* large;
+};
+
+static uint32_t arena_size_class(uint64_t size) {
+  uint32_t size_class = 0;
+  uint64_t class_size = 1 << ARENA_MIN_SHIFT;
+  while (class_size < size) {
+    class_size <<= 1;
+    size_class++;
+  }
+  return size_class;
+}
+
+// a heap whose thread exited stays in the arena for the next thread to adopt
+static void arena_heap_orphan(void* parg) {
+  struct arena_heap_t* pheap = (struct arena_heap_t*)parg;
+
+  pthread_mutex_lock(&pheap->parena->lock);
+  pheap->orphaned = 1;
+  pthread_mutex_unlock(&pheap->parena->lock);
+}
+
+static struct arena_heap_t* arena_heap_get(struct uthread_arena_t* parena) {
+  struct arena_heap_t* pheap =
+      (struct arena_heap_t*)pthread_getspecific(parena->key);
+  if (pheap) {
+    return pheap;
+  }
+
+  pthread_mutex_lock(&parena->lock);
+  for (pheap = parena->heaps; pheap; pheap = pheap->pnext) {
+    if (pheap->orphaned) {
+      pheap->orphaned = 0;
+      break;
+    }
+  }
+  if (NULL == pheap) {
+    pheap = (struct arena_heap_t*)calloc(1, sizeof(struct arena_heap_t));
+    if (pheap) {
+      pheap->parena = parena;
+      for (uint32_t i = 0; i < ARENA_CLASS_COUNT; i++) {
+        atomic_init(&pheap->remote_list[i], NULL);
+      }
+      pheap->pnext  = parena->heaps;
+      parena->heaps = pheap;
+    }
+  }
+  pthread_mutex_unlock(&parena->lock);
+
+  if (NULL == pheap) {
+    LOGE("Error: Failed to allocate memory for arena heap!");
+    return NULL;
+  }
+  pthread_setspecific(parena->key, pheap);
+
+  return pheap;
+}
+
+// hand a fresh chunk to the bump region of the heap
+static int32_t arena_heap_refill(struct arena_heap_t* pheap) {
+  struct uthread_arena_t* parena = pheap->parena;
+
+  pthread_mutex_lock(&parena->lock);
+  struct arena_chunk_t* pchunk = parena->free_chunks;
+  if (pchunk) {
+    parena->free_chunks = pchunk->pnext;
+  } else {
+    void* pmem = mmap(NULL, ARENA_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    pchunk     = MAP_FAILED == pmem ? NULL : (struct arena_chunk_t*)pmem;
+  }
+  if (pchunk) {
+    pchunk->pnext  = parena->chunks;
+    parena->chunks = pchunk;
+  }
+  pthread_mutex_unlock(&parena->lock);
+
+  if (NULL == pchunk) {
+    LOGE("Error: Failed to map a new arena chunk!");
+    return UTHREAD_FAILURE;
+  }
+  pheap->bump     = (char*)pchunk + ARENA_ALIGN;
+  pheap->bump_end = (char*)pchunk + ARENA_CHUNK_SIZE;
+
+  return UTHREAD_SUCCESS;
+}
+
+static void* arena_large_alloc(struct uthread_arena_t* parena, uint64_t size) {
+  struct arena_large_t* plarge = (struct arena_large_t*)malloc(
+      sizeof(struct arena_large_t) + sizeof(struct arena_header_t) + size);
+  if (NULL == plarge) {
+    LOGE("Error: Failed to allocate memory for a large block!");
+    return NULL;
+  }
+
+  pthread_mutex_lock(&parena->lock);
+  plarge->pprev = NULL;
+  plarge->pnext = parena->large;
+  if (parena->large) {
+    parena->large->pprev = plarge;
+  }
+  parena->large = plarge;
+  pthread_mutex_unlock(&parena->lock);
+
+  struct arena_header_t* pheader = (struct arena_header_t*)(plarge + 1);
+  pheader->pheap                 = NULL;
+  pheader->size_class            = ARENA_LARGE_CLASS;
+  return pheader + 1;
+}
+
+static void arena_large_free(struct uthread_arena_t* parena,
+                             struct arena_header_t*  pheader) {
+  struct arena_large_t* plarge = (struct arena_large_t*)pheader - 1;
+
+  pthread_mutex_lock(&parena->lock);
+  if (plarge->pprev) {
+    plarge->pprev->pnext = plarge->pnext;
+  } else {
+    parena->large = plarge->pnext;
+  }
+  if (plarge->pnext) {
+    plarge->pnext->pprev = plarge->pprev;
+  }
+  pthread_mutex_unlock(&parena->lock);
+
+  free(plarge);
+}
+
+int32_t uthread_arena_init(struct uthread_arena_t** pparena) {
+  if (NULL == pparena) {
+    LOGE("Error: Arena pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  struct uthread_arena_t* parena =
+      (struct uthread_arena_t*)calloc(1, sizeof(struct uthread_arena_t));
+  if (NULL == parena) {
+    LOGE("Error: Failed to allocate memory for arena!");
+    return UTHREAD_FAILURE;
+  }
+
+  if (RET_SUCCESS != pthread_key_create(&parena->key, arena_heap_orphan)) {
+    LOGE("Error: Failed to create the arena thread key!");
+    free(parena);
+    return UTHREAD_FAILURE;
+  }
+  if (RET_SUCCESS != pthread_mutex_init(&parena->lock, NULL)) {
+    LOGE("Error: Failed to initialize arena mutex!");
+    pthread_key_delete(parena->key);
+    free(parena);
+    return UTHREAD_FAILURE;
+  }
+
+  *pparena = parena;
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_arena_deinit(const struct uthread_arena_t* parena) {
+  if (NULL == parena) {
+    LOGE("Error: Arena pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  struct uthread_arena_t* p = (struct uthread_arena_t*)parena;
+  uthread_arena_reset(p);
+  pthread_key_delete(p->key);
+
+  while (p->free_chunks) {
+    struct arena_chunk_t* pchunk = p->free_chunks;
+    p->free_chunks               = pchunk->pnext;
+    munmap(pchunk, ARENA_CHUNK_SIZE);
+  }
+  while (p->heaps) {
+    struct arena_heap_t* pheap = p->heaps;
+    p->heaps                   = pheap->pnext;
+    free(pheap);
+  }
+  pthread_mutex_destroy(&p->lock);
+  free(p);
+
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_arena_alloc(const struct uthread_arena_t* parena,
+                            uint64_t size, void** ppmem) {
+  if (NULL == parena || NULL == ppmem) {
+    LOGE("Error: Arena or memory pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  struct uthread_arena_t* p = (struct uthread_arena_t*)parena;
+  if (size > ARENA_MAX_SIZE) {
+    *ppmem = arena_large_alloc(p, size);
+    return *ppmem ? UTHREAD_SUCCESS : UTHREAD_FAILURE;
+  }
+
+  struct arena_heap_t* pheap = arena_heap_get(p);
+  if (NULL == pheap) {
+    return UTHREAD_FAILURE;
+  }
+
+  uint32_t              size_class = arena_size_class(size);
+  struct arena_block_t* pblock     = pheap->free_list[size_class];
+  if (NULL == pblock) {
+    // take back everything other threads have freed in one go
+    pblock = atomic_exchange_explicit(&pheap->remote_list[size_class], NULL,
+                                      memory_order_acquire);
+  }
+  if (pblock) {
+    pheap->free_list[size_class] = pblock->pnext;
+    *ppmem                       = pblock;
+    return UTHREAD_SUCCESS;
+  }
+
+  uint64_t block_size = sizeof(struct arena_header_t) +
+                        ((uint64_t)1 << (size_class + ARENA_MIN_SHIFT));
+  if (NULL == pheap->bump ||
+      (uint64_t)(pheap->bump_end - pheap->bump) < block_size) {
+    if (UTHREAD_SUCCESS != arena_heap_refill(pheap)) {
+      return UTHREAD_FAILURE;
+    }
+  }
+
+  struct arena_header_t* pheader = (struct arena_header_t*)pheap->bump;
+  pheap->bump += block_size;
+  pheader->pheap      = pheap;
+  pheader->size_class = size_class;
+  *ppmem              = pheader + 1;
+
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_arena_free(const struct uthread_arena_t* parena, void* pmem) {
+  if (NULL == parena) {
+    LOGE("Error: Arena pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+  if (NULL == pmem) {
+    return UTHREAD_SUCCESS;
+  }
+
+  struct uthread_arena_t* p       = (struct uthread_arena_t*)parena;
+  struct arena_header_t*  pheader = (struct arena_header_t*)pmem - 1;
+  if (ARENA_LARGE_CLASS == pheader->size_class) {
+    arena_large_free(p, pheader);
+    return UTHREAD_SUCCESS;
+  }
+
+  struct arena_heap_t*  powner     = pheader->pheap;
+  struct arena_block_t* pblock     = (struct arena_block_t*)pmem;
+  uint32_t              size_class = pheader->size_class;
+  if (powner == pthread_getspecific(p->key)) {
+    pblock->pnext                 = powner->free_list[size_class];
+    powner->free_list[size_class] = pblock;
+    return UTHREAD_SUCCESS;
+  }
+
+  // freed by another thread, push it onto the owner's remote list
+  struct arena_block_t* phead = atomic_load_explicit(
+      &powner->remote_list[size_class], memory_order_relaxed);
+  do {
+    pblock->pnext = phead;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &powner->remote_list[size_class], &phead, pblock, memory_order_release,
+      memory_order_relaxed));
+
+  return UTHREAD_SUCCESS;
+}
+
+/* The free lists and bump pointers of every heap are rewritten behind the
+ * back of their owners, the lock only guards the list of heaps, so the caller
+ * makes sure no other thread uses the arena meanwhile. */
+int32_t uthread_arena_reset(const struct uthread_arena_t* parena) {
+  if (NULL == parena) {
+    LOGE("Error: Arena pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  struct uthread_arena_t* p = (struct uthread_arena_t*)parena;
+  pthread_mutex_lock(&p->lock);
+  for (struct arena_heap_t* pheap = p->heaps; pheap; pheap = pheap->pnext) {
+    for (uint32_t i = 0; i < ARENA_CLASS_COUNT; i++) {
+      pheap->free_list[i] = NULL;
+      atomic_store_explicit(&pheap->remote_list[i], NULL,
+                            memory_order_relaxed);
+    }
+    pheap->bump     = NULL;
+    pheap->bump_end = NULL;
+  }
+
+  // keep the chunks mapped for reuse, large blocks go back to malloc
+  while (p->chunks) {
+    struct arena_chunk_t* pchunk = p->chunks;
+    p->chunks                    = pchunk->pnext;
+    pchunk->pnext                = p->free_chunks;
+    p->free_chunks               = pchunk;
+  }
+  while (p->large) {
+    struct arena_large_t* plarge = p->large;
+    p->large                     = plarge->pnext;
+    free(plarge);
+  }
+  pthread_mutex_unlock(&p->lock);
+
+  return UTHREAD_SUCCESS;
+}
@@ -0,0 +1,184 @@
+#define _GNU_SOURCE
+
+#include "include/uthread.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// __GLIBC_PREREQ is only defined by glibc, so it can not share one #if
+#if defined(__x86_64__) && defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 35)
+#include <sys/rseq.h>
+#define UTHREAD_COUNTER_RSEQ
+#endif
+#endif
+
+#define RET_SUCCESS (0)
+#define RET_FAILURE (1)
+
+#define CACHE_LINE_SIZE (64)
+
+// every slot owns a whole cache line so that cores never share one
+struct counter_slot_t {
+  _Alignas(CACHE_LINE_SIZE) atomic_int_fast64_t value;
+};
+
+/* One slot per possible cpu plus a last one shared by the rare adds that
+ * can not use their cpu slot, which is only ever updated atomically. */
+struct uthread_counter_t {
+  struct counter_slot_t* slots;
+  uint32_t               count;
+};
+
+// slot of the calling thread when rseq is not available, 0 means unassigned
+static _Thread_local uint32_t counter_thread_slot = 0;
+static atomic_uint            counter_next_slot   = 0;
+
+static uint32_t counter_thread_index(uint32_t count) {
+  if (0 == counter_thread_slot) {
+    counter_thread_slot = atomic_fetch_add(&counter_next_slot, 1) + 1;
+  }
+  return (counter_thread_slot - 1) % count;
+}
+
+#ifdef UTHREAD_COUNTER_RSEQ
+static struct rseq* counter_rseq_area(void) {
+  return (struct rseq*)((char*)__builtin_thread_pointer() + __rseq_offset);
+}
+
+/* Add delta to *pvalue as a restartable sequence: the kernel sends the
+ * thread to the abort label if it is preempted or migrated before the add
+ * commits, so the add needs no lock prefix as long as the slot belongs to
+ * the cpu the thread runs on. */
+static int counter_rseq_add(struct rseq* prseq, int64_t* pvalue, uint32_t cpu,
+                            int64_t delta) {
+  __asm__ __volatile__ goto(
+      ".pushsection __rseq_cs, \"aw\"\n\t"
+      ".balign 32\n\t"
+      "3:\n\t"
+      ".long 0x0, 0x0\n\t"
+      ".quad 1f, (2f - 1f), 4f\n\t"
+      ".popsection\n\t"
+      "leaq 3b(%%rip), %%rax\n\t"
+      "movq %%rax, %[rseq_cs]\n\t"
+      "1:\n\t"
+      "cmpl %[cpu_id], %[current_cpu_id]\n\t"
+      "jnz %l[abort]\n\t"
+      "addq %[delta], %[value]\n\t"
+      "2:\n\t"
+      ".pushsection __rseq_failure, \"ax\"\n\t"
+      // the signature glibc registered rseq with must precede the abort ip
+      ".byte 0x0f, 0xb9, 0x3d\n\t"
+      ".long 0x53053053\n\t"
+      "4:\n\t"
+      "jmp %l[abort]\n\t"
+      ".popsection\n\t"
+      :
+      : [cpu_id] "r"(cpu), [current_cpu_id] "m"(prseq->cpu_id),
+        [rseq_cs] "m"(prseq->rseq_cs), [value] "m"(*pvalue),
+        [delta] "er"(delta)
+      : "memory", "cc", "rax"
+      : abort);
+  return RET_SUCCESS;
+abort:
+  return RET_FAILURE;
+}
+#endif
+
+int32_t uthread_counter_init(struct uthread_counter_t** ppcounter) {
+  if (NULL == ppcounter) {
+    LOGE("Error: Counter pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  struct uthread_counter_t* pcounter =
+      (struct uthread_counter_t*)malloc(sizeof(struct uthread_counter_t));
+  if (NULL == pcounter) {
+    LOGE("Error: Failed to allocate memory for counter!");
+    return UTHREAD_FAILURE;
+  }
+
+  long cpus       = sysconf(_SC_NPROCESSORS_CONF);
+  pcounter->count = cpus > 0 ? (uint32_t)cpus : 1;
+  pcounter->slots = (struct counter_slot_t*)aligned_alloc(
+      CACHE_LINE_SIZE, (pcounter->count + 1) * sizeof(struct counter_slot_t));
+  if (NULL == pcounter->slots) {
+    LOGE("Error: Failed to allocate memory for counter slots!");
+    free(pcounter);
+    return UTHREAD_FAILURE;
+  }
+  for (uint32_t i = 0; i <= pcounter->count; i++) {
+    atomic_init(&pcounter->slots[i].value, 0);
+  }
+
+  *ppcounter = pcounter;
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_counter_deinit(const struct uthread_counter_t* pcounter) {
+  if (NULL == pcounter) {
+    LOGE("Error: Counter pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  free(pcounter->slots);
+  free((void*)pcounter);
+
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_counter_add(const struct uthread_counter_t* pcounter,
+                            int64_t                         delta) {
+  if (NULL == pcounter) {
+    LOGE("Error: Counter pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  uint32_t index = pcounter->count;
+
+#ifdef UTHREAD_COUNTER_RSEQ
+  if (__rseq_size > 0) {
+    struct rseq* prseq = counter_rseq_area();
+    for (;;) {
+      uint32_t cpu = __atomic_load_n(&prseq->cpu_id_start, __ATOMIC_RELAXED);
+      if (cpu >= pcounter->count) {
+        break;
+      }
+      int64_t* pvalue = (int64_t*)&pcounter->slots[cpu].value;
+      if (RET_SUCCESS == counter_rseq_add(prseq, pvalue, cpu, delta)) {
+        return UTHREAD_SUCCESS;
+      }
+    }
+  } else {
+    index = counter_thread_index(pcounter->count);
+  }
+#else
+  index = counter_thread_index(pcounter->count);
+#endif
+
+  /* without rseq every thread adds to its own slot, atomically in case more
+   * threads than slots share one */
+  atomic_fetch_add_explicit(&pcounter->slots[index].value, delta,
+                            memory_order_relaxed);
+
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_counter_get(const struct uthread_counter_t* pcounter,
+                            int64_t*                        pvalue) {
+  if (NULL == pcounter || NULL == pvalue) {
+    LOGE("Error: Counter or value pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  int64_t sum = 0;
+  for (uint32_t i = 0; i <= pcounter->count; i++) {
+    sum += atomic_load_explicit(&pcounter->slots[i].value,
+                                memory_order_relaxed);
+  }
+  *pvalue = sum;
+
+  return UTHREAD_SUCCESS;
+}
@@ -0,0 +1,648 @@
+#define _GNU_SOURCE
+
+#include "include/uthread.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RET_SUCCESS (0)
+#define RET_FAILURE (1)
+
+#define CACHE_LINE_SIZE (64)
+
+// keys reserved for slots that were never used and slots sealed by a resize
+#define MAP_EMPTY_KEY (0)
+#define MAP_MOVED_KEY (UINT64_MAX)
+
+#define MAP_STRIPE_BITS (6)
+#define MAP_STRIPES (1 << MAP_STRIPE_BITS)
+#define MAP_MIN_CAPACITY (16)
+// number of slots a writer migrates to the new table on every operation
+#define MAP_MIGRATE_CHUNK (64)
+
+// readers announce themselves in one of these slots, picked per thread
+#define MAP_READER_SLOTS (64)
+
+// how map_probe claims an empty slot for a missing key
+#define MAP_CLAIM_NONE (0)     // never, only look the key up
+#define MAP_CLAIM_NEW (1)      // after reserving room in used
+#define MAP_CLAIM_MIGRATE (2)  // room was reserved when the resize started
+
+// value of a slot whose entry now lives in the newer table
+static char map_moved_value;
+#define MAP_MOVED ((void*)&map_moved_value)
+
+enum map_probe_result_t {
+  PROBE_FOUND,
+  PROBE_ABSENT,
+  PROBE_MOVED,
+  PROBE_FULL,
+};
+
+/* A slot is claimed once by swapping its key from MAP_EMPTY_KEY, it keeps that
+ * key for the whole lifetime of the table. A removed entry only clears the
+ * value, the slot is dropped when the table is resized. used counts claimed
+ * slots plus the room reserved for entries still to be migrated, and never
+ * exceeds the capacity, so a migration always finds an empty slot. */
+struct map_slot_t {
+  _Atomic uint64_t key;
+  _Atomic(void*)   value;
+};
+
+struct map_table_t {
+  struct map_slot_t*   slots;
+  uint64_t             mask;
+  atomic_uint_fast64_t used;
+  atomic_uint_fast64_t migrate_next;
+  atomic_uint_fast64_t migrate_done;
+  struct map_table_t*  pretired;
+};
+
+struct map_stripe_t {
+  _Alignas(CACHE_LINE_SIZE) pthread_mutex_t lock;
+  atomic_int_fast64_t count;
+};
+
+// threads inside the map per epoch parity
+struct map_reader_t {
+  _Alignas(CACHE_LINE_SIZE) atomic_int_fast64_t count[2];
+};
+
+/* Readers never lock: they look the key up in the table being migrated (if
+ * any) and then in the current one, and retry when a resize started or ended
+ * under them. Writers of the same key are serialized by one of the striped
+ * locks. Every access to the tables is counted under the current epoch, a
+ * retired table is freed after the epoch has been advanced and every thread
+ * counted under the previous one has left, as none of the later ones can
+ * still find it. */
+struct uthread_map_t {
+  _Atomic(struct map_table_t*) cur;
+  _Atomic(struct map_table_t*) old;
+  atomic_uint_fast64_t         seq;
+  pthread_mutex_t              resize_lock;
+  struct map_table_t*          pretired;
+  atomic_int                   retire_pending;
+  atomic_uint_fast64_t         epoch;
+  pthread_mutex_t              reclaim_lock;
+  struct map_stripe_t          stripes[MAP_STRIPES];
+  struct map_reader_t          readers[MAP_READER_SLOTS];
+};
+
+// reader slot of the calling thread, 0 means unassigned
+static _Thread_local uint32_t map_thread_slot = 0;
+static atomic_uint            map_next_slot   = 0;
+
+static uint64_t map_hash(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return key;
+}
+
+static struct map_stripe_t* map_stripe(struct uthread_map_t* pmap,
+                                       uint64_t              hash) {
+  // the high bits pick the stripe, the low bits pick the slot
+  return &pmap->stripes[hash >> (64 - MAP_STRIPE_BITS)];
+}
+
+static struct map_table_t* map_table_alloc(uint64_t capacity) {
+  struct map_table_t* ptable =
+      (struct map_table_t*)calloc(1, sizeof(struct map_table_t));
+  if (NULL == ptable) {
+    return NULL;
+  }
+  ptable->slots =
+      (struct map_slot_t*)calloc(capacity, sizeof(struct map_slot_t));
+  if (NULL == ptable->slots) {
+    free(ptable);
+    return NULL;
+  }
+  ptable->mask = capacity - 1;
+  atomic_init(&ptable->used, 0);
+  atomic_init(&ptable->migrate_next, 0);
+  atomic_init(&ptable->migrate_done, 0);
+  return ptable;
+}
+
+static void map_table_free(struct map_table_t* ptable) {
+  free(ptable->slots);
+  free(ptable);
+}
+
+// count the calling thread in, returns what map_leave needs to count it out
+static atomic_int_fast64_t* map_enter(struct uthread_map_t* pmap) {
+  if (0 == map_thread_slot) {
+    map_thread_slot = atomic_fetch_add(&map_next_slot, 1) + 1;
+  }
+  struct map_reader_t* preader =
+      &pmap->readers[(map_thread_slot - 1) % MAP_READER_SLOTS];
+  for (;;) {
+    uint64_t             epoch  = atomic_load(&pmap->epoch);
+    atomic_int_fast64_t* pcount = &preader->count[epoch & 1];
+    atomic_fetch_add(pcount, 1);
+    // counted under an epoch the reclaimer may have stopped waiting for
+    if (atomic_load(&pmap->epoch) == epoch) {
+      return pcount;
+    }
+    atomic_fetch_sub(pcount, 1);
+  }
+}
+
+static void map_leave(atomic_int_fast64_t* pcount) {
+  atomic_fetch_sub(pcount, 1);
+}
+
+/* Free the tables retired so far: they are unreachable for any thread
+ * entering after the epoch flip, so only the threads counted under the old
+ * epoch are waited for. Must be called outside map_enter and map_leave. */
+static void map_reclaim(struct uthread_map_t* pmap) {
+  pthread_mutex_lock(&pmap->reclaim_lock);
+  pthread_mutex_lock(&pmap->resize_lock);
+  struct map_table_t* pretired = pmap->pretired;
+  pmap->pretired               = NULL;
+  pthread_mutex_unlock(&pmap->resize_lock);
+
+  if (pretired) {
+    uint64_t epoch = atomic_fetch_add(&pmap->epoch, 1);
+    for (uint32_t i = 0; i < MAP_READER_SLOTS; i++) {
+      while (0 != atomic_load(&pmap->readers[i].count[epoch & 1])) {
+        sched_yield();
+      }
+    }
+  }
+  pthread_mutex_unlock(&pmap->reclaim_lock);
+
+  while (pretired) {
+    struct map_table_t* ptable = pretired;
+    pretired                   = ptable->pretired;
+    map_table_free(ptable);
+  }
+}
+
+// linear probing for key, claims the first empty slot on the way if asked to
+static enum map_probe_result_t map_probe(struct map_table_t* ptable,
+                                         uint64_t key, uint64_t hash,
+                                         int claim, struct map_slot_t** ppslot) {
+  uint64_t i = hash & ptable->mask;
+  for (uint64_t n = 0; n <= ptable->mask; n++, i = (i + 1) & ptable->mask) {
+    struct map_slot_t* pslot = &ptable->slots[i];
+    uint64_t k = atomic_load_explicit(&pslot->key, memory_order_acquire);
+
+    if (MAP_EMPTY_KEY == k) {
+      if (MAP_CLAIM_NONE == claim) {
+        return PROBE_ABSENT;
+      }
+      // a new key may not take the room reserved for migrated entries
+      if (MAP_CLAIM_NEW == claim &&
+          atomic_fetch_add(&ptable->used, 1) >= ptable->mask + 1) {
+        atomic_fetch_sub(&ptable->used, 1);
+        return PROBE_FULL;
+      }
+      if (atomic_compare_exchange_strong(&pslot->key, &k, key)) {
+        *ppslot = pslot;
+        return PROBE_FOUND;
+      }
+      // lost the slot to another writer or to the resize, k is the winner
+      if (MAP_CLAIM_NEW == claim) {
+        atomic_fetch_sub(&ptable->used, 1);
+      }
+    }
+    if (key == k) {
+      *ppslot = pslot;
+      return PROBE_FOUND;
+    }
+    if (MAP_MOVED_KEY == k) {
+      return PROBE_MOVED;
+    }
+  }
+
+  return PROBE_FULL;
+}
+
+// move one slot of the old table to the new one
+static void map_migrate_slot(struct uthread_map_t* pmap,
+                             struct map_table_t*   pold,
+                             struct map_table_t* pnew, uint64_t index) {
+  struct map_slot_t* pslot = &pold->slots[index];
+
+  // seal an empty slot so that late writers can not claim it any more
+  uint64_t key = MAP_EMPTY_KEY;
+  if (atomic_compare_exchange_strong(&pslot->key, &key, MAP_MOVED_KEY)) {
+    return;
+  }
+
+  uint64_t             hash    = map_hash(key);
+  struct map_stripe_t* pstripe = map_stripe(pmap, hash);
+  pthread_mutex_lock(&pstripe->lock);
+  void* pvalue = atomic_load_explicit(&pslot->value, memory_order_acquire);
+  if (MAP_MOVED != pvalue) {
+    if (NULL != pvalue) {
+      // the resize reserved a slot of the new table for every live entry
+      struct map_slot_t* pdst = NULL;
+      map_probe(pnew, key, hash, MAP_CLAIM_MIGRATE, &pdst);
+      atomic_store_explicit(&pdst->value, pvalue, memory_order_release);
+    }
+    atomic_store_explicit(&pslot->value, MAP_MOVED, memory_order_release);
+  }
+  pthread_mutex_unlock(&pstripe->lock);
+}
+
+// every writer helps a running resize by migrating one chunk of slots
+static void map_migrate_help(struct uthread_map_t* pmap) {
+  struct map_table_t* pold = atomic_load_explicit(&pmap->old,
+                                                  memory_order_acquire);
+  if (NULL == pold) {
+    return;
+  }
+  struct map_table_t* pnew = atomic_load_explicit(&pmap->cur,
+                                                  memory_order_acquire);
+  if (pnew == pold) {
+    // the resize has not published the new table yet
+    return;
+  }
+
+  uint64_t capacity = pold->mask + 1;
+  uint64_t start    = atomic_fetch_add(&pold->migrate_next, MAP_MIGRATE_CHUNK);
+  if (start >= capacity) {
+    return;
+  }
+  uint64_t end = start + MAP_MIGRATE_CHUNK;
+  if (end > capacity) {
+    end = capacity;
+  }
+  for (uint64_t i = start; i < end; i++) {
+    map_migrate_slot(pmap, pold, pnew, i);
+  }
+
+  // the writer completing the last chunk retires the old table
+  if (atomic_fetch_add(&pold->migrate_done, end - start) + (end - start) ==
+      capacity) {
+    pthread_mutex_lock(&pmap->resize_lock);
+    pold->pretired = pmap->pretired;
+    pmap->pretired = pold;
+    atomic_store_explicit(&pmap->old, NULL, memory_order_release);
+    atomic_fetch_add(&pmap->seq, 1);
+    pthread_mutex_unlock(&pmap->resize_lock);
+    // freed by the writer once it has left the map
+    atomic_store(&pmap->retire_pending, 1);
+  }
+}
+
+static int64_t map_size(struct uthread_map_t* pmap) {
+  int64_t size = 0;
+  for (uint32_t i = 0; i < MAP_STRIPES; i++) {
+    size += atomic_load_explicit(&pmap->stripes[i].count, memory_order_relaxed);
+  }
+  return size;
+}
+
+// start a resize once 3/4 of the slots are claimed, removed entries included
+static int32_t map_resize_start(struct uthread_map_t* pmap) {
+  pthread_mutex_lock(&pmap->resize_lock);
+  struct map_table_t* pcur = atomic_load_explicit(&pmap->cur,
+                                                  memory_order_relaxed);
+  uint64_t            capacity = pcur->mask + 1;
+  uint64_t            used =
+      atomic_load_explicit(&pcur->used, memory_order_relaxed);
+  if (NULL != atomic_load_explicit(&pmap->old, memory_order_relaxed) ||
+      used * 4 < capacity * 3) {
+    pthread_mutex_unlock(&pmap->resize_lock);
+    return UTHREAD_SUCCESS;
+  }
+
+  /* hold every stripe while switching tables, so that no writer claims a slot
+   * in the table being replaced and the number of live entries is exact */
+  for (uint32_t i = 0; i < MAP_STRIPES; i++) {
+    pthread_mutex_lock(&pmap->stripes[i].lock);
+  }
+
+  // grow when live entries dominate, otherwise just drop the removed ones
+  uint64_t live         = (uint64_t)map_size(pmap);
+  uint64_t new_capacity = capacity;
+  if (live * 2 > capacity) {
+    new_capacity = capacity * 2;
+  }
+  struct map_table_t* pnew = map_table_alloc(new_capacity);
+  if (NULL != pnew) {
+    // the room every live entry takes once it is migrated
+    atomic_store_explicit(&pnew->used, live, memory_order_relaxed);
+    atomic_store_explicit(&pmap->old, pcur, memory_order_release);
+    atomic_fetch_add(&pmap->seq, 1);
+    atomic_store_explicit(&pmap->cur, pnew, memory_order_release);
+  }
+
+  for (uint32_t i = 0; i < MAP_STRIPES; i++) {
+    pthread_mutex_unlock(&pmap->stripes[i].lock);
+  }
+  pthread_mutex_unlock(&pmap->resize_lock);
+
+  if (NULL == pnew) {
+    LOGE("Error: Failed to allocate memory for map resize!");
+    return UTHREAD_FAILURE;
+  }
+
+  return UTHREAD_SUCCESS;
+}
+
+/* Make sure the current table has room before a write: a full table first
+ * waits for the running migration to finish, then starts the next resize. */
+static int32_t map_reserve(struct uthread_map_t* pmap) {
+  for (;;) {
+    map_migrate_help(pmap);
+
+    struct map_table_t* pcur =
+        atomic_load_explicit(&pmap->cur, memory_order_acquire);
+    if (atomic_load_explicit(&pcur->used, memory_order_relaxed) * 4 <
+        (pcur->mask + 1) * 3) {
+      return UTHREAD_SUCCESS;
+    }
+    if (NULL != atomic_load_explicit(&pmap->old, memory_order_acquire)) {
+      sched_yield();
+      continue;
+    }
+    if (UTHREAD_SUCCESS != map_resize_start(pmap)) {
+      return UTHREAD_FAILURE;
+    }
+  }
+}
+
+// store pvalue (null removes the entry), returns the previous value
+static int32_t map_update(struct uthread_map_t* pmap, uint64_t key,
+                          void* pvalue, void** ppprev) {
+  uint64_t             hash    = map_hash(key);
+  struct map_stripe_t* pstripe = map_stripe(pmap, hash);
+
+  map_reserve(pmap);
+
+  pthread_mutex_lock(&pstripe->lock);
+  for (;;) {
+    struct map_table_t* pold =
+        atomic_load_explicit(&pmap->old, memory_order_acquire);
+    struct map_table_t* pcur =
+        atomic_load_explicit(&pmap->cur, memory_order_acquire);
+    struct map_slot_t* pslot = NULL;
+    struct map_slot_t* pprev = NULL;
+    void*              prev  = NULL;
+
+    // an entry not migrated yet still holds the latest value
+    if (pold && PROBE_FOUND ==
+                    map_probe(pold, key, hash, MAP_CLAIM_NONE, &pprev)) {
+      prev = atomic_load_explicit(&pprev->value, memory_order_acquire);
+      if (MAP_MOVED == prev) {
+        prev  = NULL;
+        pprev = NULL;
+      }
+    }
+
+    enum map_probe_result_t result = map_probe(
+        pcur, key, hash, NULL != pvalue ? MAP_CLAIM_NEW : MAP_CLAIM_NONE,
+        &pslot);
+    if (PROBE_MOVED == result) {
+      continue;
+    }
+    if (PROBE_FULL == result && NULL != pvalue) {
+      pthread_mutex_unlock(&pstripe->lock);
+      if (UTHREAD_SUCCESS != map_reserve(pmap)) {
+        LOGE("Error: Map is full!");
+        return UTHREAD_FAILURE;
+      }
+      pthread_mutex_lock(&pstripe->lock);
+      continue;
+    }
+    if (PROBE_FOUND == result) {
+      void* cur = atomic_load_explicit(&pslot->value, memory_order_acquire);
+      if (MAP_MOVED == cur) {
+        // pcur became the old table and this slot has been migrated
+        continue;
+      }
+      if (NULL == pprev) {
+        prev = cur;
+      }
+      atomic_store_explicit(&pslot->value, pvalue, memory_order_release);
+    }
+
+    /* publish in the current table first, then hide the old entry, whose
+     * reserved room is not needed any more if it was live */
+    if (pprev) {
+      atomic_store_explicit(&pprev->value, MAP_MOVED, memory_order_release);
+      if (NULL != prev) {
+        atomic_fetch_sub(&pcur->used, 1);
+      }
+    }
+
+    if (NULL == prev && NULL != pvalue) {
+      atomic_fetch_add_explicit(&pstripe->count, 1, memory_order_relaxed);
+    } else if (NULL != prev && NULL == pvalue) {
+      atomic_fetch_sub_explicit(&pstripe->count, 1, memory_order_relaxed);
+    }
+    if (ppprev) {
+      *ppprev = prev;
+    }
+    break;
+  }
+  pthread_mutex_unlock(&pstripe->lock);
+
+  return UTHREAD_SUCCESS;
+}
+
+static int32_t map_write(struct uthread_map_t* pmap, uint64_t key,
+                         void* pvalue, void** ppprev) {
+  atomic_int_fast64_t* pcount = map_enter(pmap);
+  int32_t              ret    = map_update(pmap, key, pvalue, ppprev);
+  map_leave(pcount);
+
+  if (atomic_load_explicit(&pmap->retire_pending, memory_order_relaxed) &&
+      atomic_exchange(&pmap->retire_pending, 0)) {
+    map_reclaim(pmap);
+  }
+  return ret;
+}
+
+// look key up in whichever table holds it, called between enter and leave
+static int32_t map_read(struct uthread_map_t* p, uint64_t key,
+                        void** ppvalue) {
+  uint64_t hash = map_hash(key);
+  for (;;) {
+    uint64_t seq = atomic_load_explicit(&p->seq, memory_order_acquire);
+    struct map_table_t* pold =
+        atomic_load_explicit(&p->old, memory_order_acquire);
+    struct map_table_t* pcur =
+        atomic_load_explicit(&p->cur, memory_order_acquire);
+    struct map_slot_t* pslot = NULL;
+    void*              pvalue;
+
+    if (pold && PROBE_FOUND ==
+                    map_probe(pold, key, hash, MAP_CLAIM_NONE, &pslot)) {
+      pvalue = atomic_load_explicit(&pslot->value, memory_order_acquire);
+      if (MAP_MOVED != pvalue) {
+        if (NULL == pvalue) {
+          return UTHREAD_NOT_FOUND;
+        }
+        *ppvalue = pvalue;
+        return UTHREAD_SUCCESS;
+      }
+    }
+
+    enum map_probe_result_t result =
+        map_probe(pcur, key, hash, MAP_CLAIM_NONE, &pslot);
+    if (PROBE_MOVED == result) {
+      continue;
+    }
+    if (PROBE_FOUND == result) {
+      pvalue = atomic_load_explicit(&pslot->value, memory_order_acquire);
+      if (MAP_MOVED == pvalue) {
+        continue;
+      }
+      if (NULL != pvalue) {
+        *ppvalue = pvalue;
+        return UTHREAD_SUCCESS;
+      }
+    }
+
+    // a resize may have moved the entry between the tables we looked at
+    if (atomic_load_explicit(&p->seq, memory_order_acquire) == seq) {
+      return UTHREAD_NOT_FOUND;
+    }
+  }
+}
+
+int32_t uthread_map_init(struct uthread_map_t** ppmap, uint64_t capacity) {
+  if (NULL == ppmap) {
+    LOGE("Error: Map pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  struct uthread_map_t* pmap = (struct uthread_map_t*)aligned_alloc(
+      CACHE_LINE_SIZE, (sizeof(struct uthread_map_t) + CACHE_LINE_SIZE - 1) /
+                           CACHE_LINE_SIZE * CACHE_LINE_SIZE);
+  if (NULL == pmap) {
+    LOGE("Error: Failed to allocate memory for map!");
+    return UTHREAD_FAILURE;
+  }
+  memset(pmap, 0, sizeof(struct uthread_map_t));
+
+  // room for capacity entries below the 3/4 load factor
+  uint64_t slots = MAP_MIN_CAPACITY;
+  while (slots * 3 < capacity * 4) {
+    slots *= 2;
+  }
+  struct map_table_t* ptable = map_table_alloc(slots);
+  if (NULL == ptable) {
+    LOGE("Error: Failed to allocate memory for map table!");
+    free(pmap);
+    return UTHREAD_FAILURE;
+  }
+
+  atomic_init(&pmap->cur, ptable);
+  atomic_init(&pmap->old, NULL);
+  atomic_init(&pmap->seq, 0);
+  atomic_init(&pmap->retire_pending, 0);
+  atomic_init(&pmap->epoch, 0);
+  pthread_mutex_init(&pmap->resize_lock, NULL);
+  pthread_mutex_init(&pmap->reclaim_lock, NULL);
+  for (uint32_t i = 0; i < MAP_READER_SLOTS; i++) {
+    atomic_init(&pmap->readers[i].count[0], 0);
+    atomic_init(&pmap->readers[i].count[1], 0);
+  }
+  for (uint32_t i = 0; i < MAP_STRIPES; i++) {
+    pthread_mutex_init(&pmap->stripes[i].lock, NULL);
+    atomic_init(&pmap->stripes[i].count, 0);
+  }
+
+  *ppmap = pmap;
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_map_deinit(const struct uthread_map_t* pmap) {
+  if (NULL == pmap) {
+    LOGE("Error: Map pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  struct uthread_map_t* p = (struct uthread_map_t*)pmap;
+  map_table_free(atomic_load(&p->cur));
+  if (atomic_load(&p->old)) {
+    map_table_free(atomic_load(&p->old));
+  }
+  while (p->pretired) {
+    struct map_table_t* ptable = p->pretired;
+    p->pretired                = ptable->pretired;
+    map_table_free(ptable);
+  }
+
+  pthread_mutex_destroy(&p->resize_lock);
+  pthread_mutex_destroy(&p->reclaim_lock);
+  for (uint32_t i = 0; i < MAP_STRIPES; i++) {
+    pthread_mutex_destroy(&p->stripes[i].lock);
+  }
+  free(p);
+
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_map_put(const struct uthread_map_t* pmap, uint64_t key,
+                        void* pvalue) {
+  if (NULL == pmap || NULL == pvalue) {
+    LOGE("Error: Map or value pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+  if (MAP_EMPTY_KEY == key || MAP_MOVED_KEY == key) {
+    LOGE("Error: Key 0x%lx is reserved!", key);
+    return UTHREAD_FAILURE;
+  }
+
+  return map_write((struct uthread_map_t*)pmap, key, pvalue, NULL);
+}
+
+int32_t uthread_map_get(const struct uthread_map_t* pmap, uint64_t key,
+                        void** ppvalue) {
+  if (NULL == pmap || NULL == ppvalue) {
+    LOGE("Error: Map or value pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+  if (MAP_EMPTY_KEY == key || MAP_MOVED_KEY == key) {
+    return UTHREAD_NOT_FOUND;
+  }
+
+  struct uthread_map_t* p      = (struct uthread_map_t*)pmap;
+  atomic_int_fast64_t*  pcount = map_enter(p);
+  int32_t               ret    = map_read(p, key, ppvalue);
+  map_leave(pcount);
+  return ret;
+}
+
+int32_t uthread_map_remove(const struct uthread_map_t* pmap, uint64_t key) {
+  if (NULL == pmap) {
+    LOGE("Error: Map pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+  if (MAP_EMPTY_KEY == key || MAP_MOVED_KEY == key) {
+    return UTHREAD_NOT_FOUND;
+  }
+
+  void*   prev = NULL;
+  int32_t ret  = map_write((struct uthread_map_t*)pmap, key, NULL, &prev);
+  if (UTHREAD_SUCCESS != ret) {
+    return ret;
+  }
+
+  return NULL == prev ? UTHREAD_NOT_FOUND : UTHREAD_SUCCESS;
+}
+
+int32_t uthread_map_size(const struct uthread_map_t* pmap, uint64_t* psize) {
+  if (NULL == pmap || NULL == psize) {
+    LOGE("Error: Map or size pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  int64_t size = map_size((struct uthread_map_t*)pmap);
+  *psize       = size > 0 ? (uint64_t)size : 0;
+
+  return UTHREAD_SUCCESS;
+}
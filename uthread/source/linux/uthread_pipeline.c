@@ -0,0 +1,412 @@
+#include "include/uthread.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RET_SUCCESS (0)
+#define RET_FAILURE (1)
+
+#define DEFAULT_QUEUE_CAPACITY (64)
+
+// bounded FIFO in front of each stage, producers block while it is full
+struct uthread_queue_t {
+  pthread_mutex_t lock;
+  pthread_cond_t  not_full;
+  pthread_cond_t  not_empty;
+  void**          items;
+  uint32_t        capacity;
+  uint32_t        head;
+  uint32_t        count;
+  uint32_t        closed;
+  uint64_t        full_waits;
+};
+
+struct uthread_stage_t;
+
+struct uthread_worker_t {
+  struct uthread_stage_t* pstage;
+  struct uthread_t*       phandle;
+  void**                  ppin;
+  void**                  ppout;
+};
+
+struct uthread_stage_t {
+  uthread_stage_func_t      func;
+  void*                     arg;
+  uint32_t                  parallelism;
+  uint32_t                  batch_size;
+  struct uthread_queue_t    input;
+  struct uthread_stage_t*   pnext;
+  struct uthread_worker_t*  pworkers;
+  void**                    pbuffers;
+  atomic_uint               active;
+  // bumped by every worker on every batch, so sharded per cpu
+  struct uthread_counter_t* pitems_in;
+  struct uthread_counter_t* pitems_out;
+  struct uthread_counter_t* pbatches;
+};
+
+struct uthread_pipeline_t {
+  struct uthread_stage_t* pstages;
+  uint32_t                count;
+  uint32_t                finished;
+};
+
+static int32_t queue_init(struct uthread_queue_t* pqueue, uint32_t capacity) {
+  memset(pqueue, 0, sizeof(struct uthread_queue_t));
+  pqueue->items = (void**)malloc(capacity * sizeof(void*));
+  if (NULL == pqueue->items) {
+    LOGE("Error: Failed to allocate memory for queue!");
+    return UTHREAD_FAILURE;
+  }
+  pqueue->capacity = capacity;
+
+  if (RET_SUCCESS != pthread_mutex_init(&pqueue->lock, NULL)) {
+    LOGE("Error: Failed to initialize queue mutex!");
+    free(pqueue->items);
+    return UTHREAD_FAILURE;
+  }
+  if (RET_SUCCESS != pthread_cond_init(&pqueue->not_full, NULL)) {
+    LOGE("Error: Failed to initialize queue condition variable!");
+    pthread_mutex_destroy(&pqueue->lock);
+    free(pqueue->items);
+    return UTHREAD_FAILURE;
+  }
+  if (RET_SUCCESS != pthread_cond_init(&pqueue->not_empty, NULL)) {
+    LOGE("Error: Failed to initialize queue condition variable!");
+    pthread_cond_destroy(&pqueue->not_full);
+    pthread_mutex_destroy(&pqueue->lock);
+    free(pqueue->items);
+    return UTHREAD_FAILURE;
+  }
+
+  return UTHREAD_SUCCESS;
+}
+
+static void queue_deinit(struct uthread_queue_t* pqueue) {
+  pthread_cond_destroy(&pqueue->not_empty);
+  pthread_cond_destroy(&pqueue->not_full);
+  pthread_mutex_destroy(&pqueue->lock);
+  free(pqueue->items);
+  pqueue->items = NULL;
+}
+
+// push count items, blocking while the queue is full (backpressure)
+static int32_t queue_push(struct uthread_queue_t* pqueue, void* const* ppitems,
+                          uint32_t count) {
+  uint32_t i = 0;
+
+  pthread_mutex_lock(&pqueue->lock);
+  while (i < count) {
+    // count the blocking once, wakeups that lose the race wait again
+    if (pqueue->count == pqueue->capacity && !pqueue->closed) {
+      pqueue->full_waits++;
+    }
+    while (pqueue->count == pqueue->capacity && !pqueue->closed) {
+      pthread_cond_wait(&pqueue->not_full, &pqueue->lock);
+    }
+    if (pqueue->closed) {
+      pthread_mutex_unlock(&pqueue->lock);
+      LOGE("Error: Queue is already closed!");
+      return UTHREAD_FAILURE;
+    }
+
+    while (i < count && pqueue->count < pqueue->capacity) {
+      uint32_t tail = (pqueue->head + pqueue->count) % pqueue->capacity;
+      pqueue->items[tail] = ppitems[i++];
+      pqueue->count++;
+    }
+    pthread_cond_broadcast(&pqueue->not_empty);
+  }
+  pthread_mutex_unlock(&pqueue->lock);
+
+  return UTHREAD_SUCCESS;
+}
+
+// pop up to max items without waiting for a full batch, returns 0 once the
+// queue is closed and drained
+static uint32_t queue_pop(struct uthread_queue_t* pqueue, void** ppitems,
+                          uint32_t max) {
+  uint32_t n = 0;
+
+  pthread_mutex_lock(&pqueue->lock);
+  while (0 == pqueue->count && !pqueue->closed) {
+    pthread_cond_wait(&pqueue->not_empty, &pqueue->lock);
+  }
+
+  while (n < max && pqueue->count > 0) {
+    ppitems[n++] = pqueue->items[pqueue->head];
+    pqueue->head = (pqueue->head + 1) % pqueue->capacity;
+    pqueue->count--;
+  }
+  if (n > 0) {
+    pthread_cond_broadcast(&pqueue->not_full);
+  }
+  pthread_mutex_unlock(&pqueue->lock);
+
+  return n;
+}
+
+static void queue_close(struct uthread_queue_t* pqueue) {
+  pthread_mutex_lock(&pqueue->lock);
+  pqueue->closed = 1;
+  pthread_cond_broadcast(&pqueue->not_empty);
+  pthread_cond_broadcast(&pqueue->not_full);
+  pthread_mutex_unlock(&pqueue->lock);
+}
+
+static void* stage_worker(void* parg) {
+  struct uthread_worker_t* pworker = (struct uthread_worker_t*)parg;
+  struct uthread_stage_t*  pstage  = pworker->pstage;
+
+  for (;;) {
+    uint32_t n = queue_pop(&pstage->input, pworker->ppin, pstage->batch_size);
+    if (0 == n) {
+      break;
+    }
+    uthread_counter_add(pstage->pitems_in, n);
+    uthread_counter_add(pstage->pbatches, 1);
+
+    uint32_t out = pstage->func(pworker->ppin, n, pworker->ppout, pstage->arg);
+    if (out > n) {
+      LOGE("Error: Stage function returned more items than it was given!");
+      out = n;
+    }
+    if (out > 0 && pstage->pnext) {
+      queue_push(&pstage->pnext->input, pworker->ppout, out);
+    }
+    uthread_counter_add(pstage->pitems_out, out);
+  }
+
+  // the last worker leaving a stage closes the input of the next stage
+  if (1 == atomic_fetch_sub(&pstage->active, 1) && pstage->pnext) {
+    queue_close(&pstage->pnext->input);
+  }
+
+  return NULL;
+}
+
+static void stage_deinit(struct uthread_stage_t* pstage) {
+  if (pstage->pitems_in) {
+    uthread_counter_deinit(pstage->pitems_in);
+  }
+  if (pstage->pitems_out) {
+    uthread_counter_deinit(pstage->pitems_out);
+  }
+  if (pstage->pbatches) {
+    uthread_counter_deinit(pstage->pbatches);
+  }
+  queue_deinit(&pstage->input);
+  free(pstage->pworkers);
+  free(pstage->pbuffers);
+}
+
+static int32_t stage_init(struct uthread_stage_t*            pstage,
+                          const struct uthread_stage_attr_t* pattr) {
+  memset(pstage, 0, sizeof(struct uthread_stage_t));
+  pstage->func        = pattr->func;
+  pstage->arg         = pattr->arg;
+  pstage->parallelism = pattr->parallelism ? pattr->parallelism : 1;
+  pstage->batch_size  = pattr->batch_size ? pattr->batch_size : 1;
+  atomic_init(&pstage->active, 0);
+
+  uint32_t capacity =
+      pattr->queue_capacity ? pattr->queue_capacity : DEFAULT_QUEUE_CAPACITY;
+  if (UTHREAD_SUCCESS != queue_init(&pstage->input, capacity)) {
+    return UTHREAD_FAILURE;
+  }
+
+  if (UTHREAD_SUCCESS != uthread_counter_init(&pstage->pitems_in) ||
+      UTHREAD_SUCCESS != uthread_counter_init(&pstage->pitems_out) ||
+      UTHREAD_SUCCESS != uthread_counter_init(&pstage->pbatches)) {
+    stage_deinit(pstage);
+    return UTHREAD_FAILURE;
+  }
+
+  pstage->pworkers = (struct uthread_worker_t*)calloc(
+      pstage->parallelism, sizeof(struct uthread_worker_t));
+  pstage->pbuffers = (void**)malloc(2 * (size_t)pstage->parallelism *
+                                    pstage->batch_size * sizeof(void*));
+  if (NULL == pstage->pworkers || NULL == pstage->pbuffers) {
+    LOGE("Error: Failed to allocate memory for stage workers!");
+    stage_deinit(pstage);
+    return UTHREAD_FAILURE;
+  }
+
+  for (uint32_t i = 0; i < pstage->parallelism; i++) {
+    struct uthread_worker_t* pworker = &pstage->pworkers[i];
+    pworker->pstage = pstage;
+    pworker->ppin   = pstage->pbuffers + 2 * (size_t)i * pstage->batch_size;
+    pworker->ppout  = pworker->ppin + pstage->batch_size;
+  }
+
+  return UTHREAD_SUCCESS;
+}
+
+// join the started workers of every stage and release their handles
+static void pipeline_join(struct uthread_pipeline_t* ppipeline) {
+  for (uint32_t s = 0; s < ppipeline->count; s++) {
+    struct uthread_stage_t* pstage = &ppipeline->pstages[s];
+    for (uint32_t i = 0; i < pstage->parallelism; i++) {
+      struct uthread_worker_t* pworker = &pstage->pworkers[i];
+      if (pworker->phandle) {
+        uthread_join(pworker->phandle);
+        uthread_release(pworker->phandle);
+        pworker->phandle = NULL;
+      }
+    }
+  }
+}
+
+int32_t uthread_pipeline_init(struct uthread_pipeline_t**        pppipeline,
+                              const struct uthread_stage_attr_t* pstages,
+                              uint32_t                           count) {
+  if (NULL == pppipeline || NULL == pstages || 0 == count) {
+    LOGE("Error: Pipeline pointer or stage list is null!");
+    return UTHREAD_FAILURE;
+  }
+  for (uint32_t s = 0; s < count; s++) {
+    if (NULL == pstages[s].func) {
+      LOGE("Error: function of stage %u is not specified!", s);
+      return UTHREAD_FAILURE;
+    }
+  }
+
+  struct uthread_pipeline_t* ppipeline =
+      (struct uthread_pipeline_t*)calloc(1, sizeof(struct uthread_pipeline_t));
+  if (NULL == ppipeline) {
+    LOGE("Error: Failed to allocate memory for pipeline!");
+    return UTHREAD_FAILURE;
+  }
+  ppipeline->pstages =
+      (struct uthread_stage_t*)calloc(count, sizeof(struct uthread_stage_t));
+  if (NULL == ppipeline->pstages) {
+    LOGE("Error: Failed to allocate memory for pipeline stages!");
+    free(ppipeline);
+    return UTHREAD_FAILURE;
+  }
+
+  for (uint32_t s = 0; s < count; s++) {
+    if (UTHREAD_SUCCESS != stage_init(&ppipeline->pstages[s], &pstages[s])) {
+      for (uint32_t j = 0; j < s; j++) {
+        stage_deinit(&ppipeline->pstages[j]);
+      }
+      free(ppipeline->pstages);
+      free(ppipeline);
+      return UTHREAD_FAILURE;
+    }
+    if (s > 0) {
+      ppipeline->pstages[s - 1].pnext = &ppipeline->pstages[s];
+    }
+  }
+  ppipeline->count = count;
+
+  for (uint32_t s = 0; s < count; s++) {
+    struct uthread_stage_t* pstage = &ppipeline->pstages[s];
+    for (uint32_t i = 0; i < pstage->parallelism; i++) {
+      struct uthread_worker_t* pworker = &pstage->pworkers[i];
+      atomic_fetch_add(&pstage->active, 1);
+      int32_t ret = uthread_create(&pworker->phandle, NULL,
+                                   (void*)stage_worker, (void*)pworker);
+      if (UTHREAD_SUCCESS != ret) {
+        LOGE("Error: Failed to start worker %u of stage %u!", i, s);
+        pworker->phandle = NULL;
+        // let the workers started so far drain and exit
+        if (1 == atomic_fetch_sub(&pstage->active, 1) && pstage->pnext) {
+          queue_close(&pstage->pnext->input);
+        }
+        queue_close(&ppipeline->pstages[0].input);
+        pipeline_join(ppipeline);
+        for (uint32_t j = 0; j < count; j++) {
+          stage_deinit(&ppipeline->pstages[j]);
+        }
+        free(ppipeline->pstages);
+        free(ppipeline);
+        return UTHREAD_FAILURE;
+      }
+    }
+  }
+
+  *pppipeline = ppipeline;
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_pipeline_push(const struct uthread_pipeline_t* ppipeline,
+                              void*                            pitem) {
+  if (NULL == ppipeline) {
+    LOGE("Error: Pipeline pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  return queue_push(&ppipeline->pstages[0].input, &pitem, 1);
+}
+
+int32_t uthread_pipeline_finish(const struct uthread_pipeline_t* ppipeline) {
+  if (NULL == ppipeline) {
+    LOGE("Error: Pipeline pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  struct uthread_pipeline_t* p = (struct uthread_pipeline_t*)ppipeline;
+  if (p->finished) {
+    return UTHREAD_SUCCESS;
+  }
+
+  // closing the first queue drains the stages one after another
+  queue_close(&p->pstages[0].input);
+  pipeline_join(p);
+  p->finished = 1;
+
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_pipeline_stats_get(const struct uthread_pipeline_t* ppipeline,
+                                   uint32_t                         index,
+                                   struct uthread_stage_stats_t*    pstats) {
+  if (NULL == ppipeline || NULL == pstats) {
+    LOGE("Error: Pipeline or stats pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+  if (index >= ppipeline->count) {
+    LOGE("Error: Stage index %u is out of range!", index);
+    return UTHREAD_FAILURE;
+  }
+
+  struct uthread_stage_t* pstage = &ppipeline->pstages[index];
+  int64_t                 value  = 0;
+  uthread_counter_get(pstage->pitems_in, &value);
+  pstats->items_in = (uint64_t)value;
+  uthread_counter_get(pstage->pitems_out, &value);
+  pstats->items_out = (uint64_t)value;
+  uthread_counter_get(pstage->pbatches, &value);
+  pstats->batches     = (uint64_t)value;
+  pstats->parallelism = pstage->parallelism;
+
+  pthread_mutex_lock(&pstage->input.lock);
+  pstats->full_waits     = pstage->input.full_waits;
+  pstats->queue_depth    = pstage->input.count;
+  pstats->queue_capacity = pstage->input.capacity;
+  pthread_mutex_unlock(&pstage->input.lock);
+
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_pipeline_deinit(const struct uthread_pipeline_t* ppipeline) {
+  if (NULL == ppipeline) {
+    LOGE("Error: Pipeline pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  uthread_pipeline_finish(ppipeline);
+
+  for (uint32_t s = 0; s < ppipeline->count; s++) {
+    stage_deinit(&ppipeline->pstages[s]);
+  }
+  free(ppipeline->pstages);
+  free((void*)ppipeline);
+
+  return UTHREAD_SUCCESS;
+}
@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+
+#include "include/uthread.h"
+
+#include <limits.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define RET_SUCCESS (0)
+#define RET_FAILURE (1)
+
+#define STACK_HUGE_PAGE_SIZE (2UL << 20)  // transparent huge page on x86_64
+#define STACK_MAX_NUMA_NODE (1024)
+#define STACK_MASK_BITS (8 * sizeof(unsigned long))
+
+// an idle stack links to the next one through its lowest word
+struct stack_node_t {
+  struct stack_node_t* next;
+};
+
+struct stack_class_t {
+  struct uthread_stack_attr_t attr;   // size rounded up to whole pages
+  uint64_t                    guard;  // PROT_NONE bytes below every stack
+  struct stack_node_t*        idle;
+  uint32_t                    allocated;
+  uint32_t                    idle_count;
+  int                         initialized;
+};
+
+static struct stack_class_t stack_classes[UTHREAD_STACK_CLASS_COUNT];
+static pthread_mutex_t      stack_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int32_t stack_bind(void* pstack, uint64_t size, int32_t node) {
+  unsigned long mask[STACK_MAX_NUMA_NODE / STACK_MASK_BITS];
+  memset(mask, 0, sizeof(mask));
+  mask[node / STACK_MASK_BITS] = 1UL << (node % STACK_MASK_BITS);
+
+  // the kernel expects the number of bits in the mask plus one
+  if (RET_SUCCESS != syscall(SYS_mbind, pstack, size, MPOL_BIND, mask,
+                             STACK_MAX_NUMA_NODE + 1, 0)) {
+    LOGE("Error: failed to bind a stack to NUMA node %d!", node);
+    return UTHREAD_FAILURE;
+  }
+  return UTHREAD_SUCCESS;
+}
+
+/* Map one stack of the class with a guard page below it, the returned
+ * pointer is the lowest usable address. */
+static int32_t stack_map(const struct stack_class_t* pclass, void** ppstack) {
+  uint64_t size  = pclass->attr.size;
+  uint64_t guard = pclass->guard;
+  uint64_t align = 0;
+  if (pclass->attr.flags & UTHREAD_STACK_HUGEPAGE) {
+    align = STACK_HUGE_PAGE_SIZE;
+  }
+
+  // map spare room to align the stack to a huge page, trimmed below
+  uint64_t length = guard + size + align;
+  uint8_t* pmap   = (uint8_t*)mmap(NULL, length, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK,
+                                   -1, 0);
+  if (MAP_FAILED == (void*)pmap) {
+    LOGE("Error: failed to map a stack of %lu bytes!", size);
+    return UTHREAD_FAILURE;
+  }
+
+  uint8_t* pstack = pmap + guard;
+  if (align) {
+    pstack = (uint8_t*)(((uintptr_t)pstack + align - 1) & ~(align - 1));
+    if (pstack - guard > pmap) {
+      munmap(pmap, pstack - guard - pmap);
+    }
+    if (pmap + length > pstack + size) {
+      munmap(pstack + size, pmap + length - (pstack + size));
+    }
+    madvise(pstack, size, MADV_HUGEPAGE);
+  }
+
+  if (RET_SUCCESS != mprotect(pstack - guard, guard, PROT_NONE)) {
+    LOGE("Error: failed to protect the guard page of a stack!");
+    munmap(pstack - guard, guard + size);
+    return UTHREAD_FAILURE;
+  }
+
+  if ((pclass->attr.flags & UTHREAD_STACK_NUMA) &&
+      UTHREAD_SUCCESS != stack_bind(pstack, size, pclass->attr.numa_node)) {
+    munmap(pstack - guard, guard + size);
+    return UTHREAD_FAILURE;
+  }
+
+  /* touch every page from the top, where a new thread starts, the guard is
+   * exactly one page long */
+  if (pclass->attr.flags & UTHREAD_STACK_PREFAULT) {
+    for (uint64_t offset = size; offset > 0; offset -= guard) {
+      ((volatile uint8_t*)pstack)[offset - 1] = 0;
+    }
+  }
+
+  *ppstack = pstack;
+  return UTHREAD_SUCCESS;
+}
+
+static void stack_unmap(const struct stack_class_t* pclass, void* pstack) {
+  munmap((uint8_t*)pstack - pclass->guard, pclass->guard + pclass->attr.size);
+}
+
+static int32_t stack_class_check(int32_t stack_class) {
+  if (stack_class < 1 || stack_class > UTHREAD_STACK_CLASS_COUNT) {
+    LOGE("Error: stack class %d is out of range 1-%d!", stack_class,
+         UTHREAD_STACK_CLASS_COUNT);
+    return UTHREAD_FAILURE;
+  }
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_stack_pool_init(int32_t                            stack_class,
+                                const struct uthread_stack_attr_t* pattr) {
+  if (UTHREAD_SUCCESS != stack_class_check(stack_class)) {
+    return UTHREAD_FAILURE;
+  }
+  if (NULL == pattr) {
+    LOGE("Error: Stack attributes pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+  if ((pattr->flags & UTHREAD_STACK_NUMA) &&
+      (pattr->numa_node < 0 || pattr->numa_node >= STACK_MAX_NUMA_NODE)) {
+    LOGE("Error: NUMA node %d is out of range!", pattr->numa_node);
+    return UTHREAD_FAILURE;
+  }
+
+  struct stack_class_t local;
+  memset(&local, 0, sizeof(struct stack_class_t));
+  local.attr  = *pattr;
+  local.guard = (uint64_t)sysconf(_SC_PAGESIZE);
+
+  uint64_t unit = local.guard;
+  if (pattr->flags & UTHREAD_STACK_HUGEPAGE) {
+    unit = STACK_HUGE_PAGE_SIZE;
+  }
+  if (local.attr.size < (uint64_t)PTHREAD_STACK_MIN) {
+    local.attr.size = PTHREAD_STACK_MIN;
+  }
+  local.attr.size = (local.attr.size + unit - 1) & ~(unit - 1);
+
+  // preallocate outside the lock, the class is not visible yet
+  for (uint32_t i = 0; i < pattr->count; i++) {
+    void* pstack = NULL;
+    if (UTHREAD_SUCCESS != stack_map(&local, &pstack)) {
+      break;
+    }
+    struct stack_node_t* pnode = (struct stack_node_t*)pstack;
+    pnode->next                = local.idle;
+    local.idle                 = pnode;
+    local.allocated++;
+  }
+  local.idle_count  = local.allocated;
+  local.initialized = 1;
+
+  struct stack_class_t* pclass = &stack_classes[stack_class - 1];
+  pthread_mutex_lock(&stack_lock);
+  int busy = pclass->initialized;
+  if (!busy && local.allocated == pattr->count) {
+    *pclass = local;
+  }
+  pthread_mutex_unlock(&stack_lock);
+
+  if (busy || local.allocated != pattr->count) {
+    if (busy) {
+      LOGE("Error: stack class %d is already initialized!", stack_class);
+    }
+    while (local.idle) {
+      struct stack_node_t* pnode = local.idle;
+      local.idle                 = pnode->next;
+      stack_unmap(&local, pnode);
+    }
+    return UTHREAD_FAILURE;
+  }
+
+  LOGI("Stack class %d holds %u stacks of %lu bytes", stack_class,
+       local.allocated, local.attr.size);
+
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_stack_pool_deinit(int32_t stack_class) {
+  if (UTHREAD_SUCCESS != stack_class_check(stack_class)) {
+    return UTHREAD_FAILURE;
+  }
+
+  struct stack_class_t* pclass = &stack_classes[stack_class - 1];
+  struct stack_class_t  local;
+  pthread_mutex_lock(&stack_lock);
+  if (!pclass->initialized) {
+    pthread_mutex_unlock(&stack_lock);
+    LOGE("Error: stack class %d is not initialized!", stack_class);
+    return UTHREAD_FAILURE;
+  }
+  if (pclass->idle_count != pclass->allocated) {
+    uint32_t used = pclass->allocated - pclass->idle_count;
+    pthread_mutex_unlock(&stack_lock);
+    LOGE("Error: %u stacks of class %d are still in use!", used, stack_class);
+    return UTHREAD_FAILURE;
+  }
+  local = *pclass;
+  memset(pclass, 0, sizeof(struct stack_class_t));
+  pthread_mutex_unlock(&stack_lock);
+
+  while (local.idle) {
+    struct stack_node_t* pnode = local.idle;
+    local.idle                 = pnode->next;
+    stack_unmap(&local, pnode);
+  }
+
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_stack_pool_stats_get(int32_t                       stack_class,
+                                     struct uthread_stack_stats_t* pstats) {
+  if (UTHREAD_SUCCESS != stack_class_check(stack_class)) {
+    return UTHREAD_FAILURE;
+  }
+  if (NULL == pstats) {
+    LOGE("Error: Stats pointer is null!");
+    return UTHREAD_FAILURE;
+  }
+
+  struct stack_class_t* pclass = &stack_classes[stack_class - 1];
+  pthread_mutex_lock(&stack_lock);
+  pstats->size      = pclass->attr.size;
+  pstats->allocated = pclass->allocated;
+  pstats->idle      = pclass->idle_count;
+  pthread_mutex_unlock(&stack_lock);
+
+  return UTHREAD_SUCCESS;
+}
+
+/* Take an idle stack of the class for a new thread, or map another one with
+ * the same settings when all of them are in use. */
+int32_t stack_pool_acquire(int32_t stack_class, void** ppstack,
+                           uint64_t* psize) {
+  if (UTHREAD_SUCCESS != stack_class_check(stack_class)) {
+    return UTHREAD_FAILURE;
+  }
+
+  struct stack_class_t* pclass = &stack_classes[stack_class - 1];
+  pthread_mutex_lock(&stack_lock);
+  if (!pclass->initialized) {
+    pthread_mutex_unlock(&stack_lock);
+    LOGE("Error: stack class %d is not initialized!", stack_class);
+    return UTHREAD_FAILURE;
+  }
+  *psize = pclass->attr.size;
+  if (pclass->idle) {
+    struct stack_node_t* pnode = pclass->idle;
+    pclass->idle               = pnode->next;
+    pclass->idle_count--;
+    pthread_mutex_unlock(&stack_lock);
+    *ppstack = pnode;
+    return UTHREAD_SUCCESS;
+  }
+  // count the new stack as in use so that the class can not go away
+  struct stack_class_t local = *pclass;
+  pclass->allocated++;
+  pthread_mutex_unlock(&stack_lock);
+
+  if (UTHREAD_SUCCESS != stack_map(&local, ppstack)) {
+    pthread_mutex_lock(&stack_lock);
+    pclass->allocated--;
+    pthread_mutex_unlock(&stack_lock);
+    return UTHREAD_FAILURE;
+  }
+  return UTHREAD_SUCCESS;
+}
+
+// Give the stack of a joined thread back to its class for the next thread
+void stack_pool_return(int32_t stack_class, void* pstack) {
+  struct stack_class_t* pclass = &stack_classes[stack_class - 1];
+  struct stack_node_t*  pnode  = (struct stack_node_t*)pstack;
+  pthread_mutex_lock(&stack_lock);
+  pnode->next  = pclass->idle;
+  pclass->idle = pnode;
+  pclass->idle_count++;
+  pthread_mutex_unlock(&stack_lock);
+}
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <windows.h>
 
 #define RET_SUCCESS (1)
@@ -11,12 +12,58 @@ typedef struct {
   HANDLE                 handle;
   DWORD                  id;
   LPTHREAD_START_ROUTINE func;
-  SECURITY_ATTRIBUTES*   attr;
+  struct uthread_attr_t  attr;
   void*                  arg;
+  // argument of a thread started by uthread_prepare and uthread_start
+  __declspec(align(UTHREAD_INLINE_ALIGN)) uint8_t storage[UTHREAD_INLINE_SIZE];
 } thread_t;
 
-int32_t uthread_create(void** pphandle, const void* pattr, const void* pfunc,
-                       const void* parg) {
+// map a scheduling policy onto a Windows thread priority level
+static int priority_level(int32_t policy, int32_t priority) {
+  if (UTHREAD_SCHED_FIFO == policy || UTHREAD_SCHED_RR == policy) {
+    return priority >= 50 ? THREAD_PRIORITY_TIME_CRITICAL
+                          : THREAD_PRIORITY_HIGHEST;
+  }
+  return THREAD_PRIORITY_NORMAL;
+}
+
+/* Create the thread suspended, so that the priority of pattr is in effect
+ * before it runs. A zero policy keeps the default priority, Windows threads
+ * do not inherit the creator's one. */
+static int32_t thread_start(thread_t*                    phandle,
+                            const struct uthread_attr_t* pattr) {
+  if (pattr) {
+    phandle->attr = *pattr;
+  } else {
+    memset(&phandle->attr, 0, sizeof(struct uthread_attr_t));
+  }
+
+  HANDLE hThread = CreateThread(NULL, 0, phandle->func, phandle->arg,
+                                CREATE_SUSPENDED, &phandle->id);
+  if (NULL == hThread) {
+    LOGE("Error: failed to create a thread!");
+    return UTHREAD_FAILURE;
+  }
+
+  if (UTHREAD_SCHED_INHERIT != phandle->attr.policy &&
+      RET_FAILURE ==
+          SetThreadPriority(hThread, priority_level(phandle->attr.policy,
+                                                    phandle->attr.priority))) {
+    LOGE("Error: failed to set the thread priority!");
+    TerminateThread(hThread, 0);
+    CloseHandle(hThread);
+    return UTHREAD_FAILURE;
+  }
+  ResumeThread(hThread);
+  phandle->handle = hThread;
+
+  LOGI("The thread with ID=0x%lx is created", phandle->id);
+
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_create(void** pphandle, const struct uthread_attr_t* pattr,
+                       const void* pfunc, const void* parg) {
   if (NULL == pfunc) {
     LOGE("Error: thread function is not specified!");
     return UTHREAD_FAILURE;
@@ -27,33 +74,58 @@ int32_t uthread_create(void** pphandle, const void* pattr, const void* pfunc,
     return UTHREAD_FAILURE;
   }
 
-  if (pattr) {
-    phandle->attr = (SECURITY_ATTRIBUTES*)pattr;
-  } else {
-    phandle->attr = NULL;
-  }
-
   phandle->func = (LPTHREAD_START_ROUTINE)pfunc;
   phandle->arg  = (void *)parg;
 
-  HANDLE hThread;
-  hThread = CreateThread(NULL, 0, phandle->func, phandle->arg, 0, &phandle->id);
-
-  if (NULL == hThread) {
-    LOGE("Error: failed to create a thread!");
+  int32_t ret = thread_start(phandle, pattr);
+  if (UTHREAD_SUCCESS != ret) {
     free(phandle);
     phandle = NULL;
-    return UTHREAD_FAILURE;
+    return ret;
   }
 
-  *pphandle       = (void*)phandle;
-  phandle->handle = hThread;
+  *pphandle = (void*)phandle;
+  return UTHREAD_SUCCESS;
+}
 
-  LOGI("The thread with ID=0x%lx is created", phandle->id);
+int32_t uthread_prepare(void** pphandle, void** ppstorage) {
+  if (NULL == pphandle || NULL == ppstorage) {
+    LOGE("Error: please pass valid handle and storage pointers!");
+    return UTHREAD_FAILURE;
+  }
+  thread_t* phandle = (thread_t*)malloc(sizeof(thread_t));
+  if (NULL == phandle) {
+    LOGE("Error: failed to allocate memory!");
+    return UTHREAD_FAILURE;
+  }
+  memset(phandle, 0, sizeof(thread_t));
 
+  // the thread function receives the storage inside the handle as argument
+  phandle->arg = phandle->storage;
+
+  *pphandle    = (void*)phandle;
+  *ppstorage   = phandle->storage;
   return UTHREAD_SUCCESS;
 }
 
+int32_t uthread_start(const void* phandle, const struct uthread_attr_t* pattr,
+                      const void* pfunc) {
+  if (NULL == phandle) {
+    LOGE(
+        "Error: thread handle is null, please prepare a thread first!");
+    return UTHREAD_FAILURE;
+  }
+  if (NULL == pfunc) {
+    LOGE("Error: thread function is not specified!");
+    return UTHREAD_FAILURE;
+  }
+
+  thread_t* pthread = (thread_t*)phandle;
+  pthread->func     = (LPTHREAD_START_ROUTINE)pfunc;
+
+  return thread_start(pthread, pattr);
+}
+
 int32_t uthread_join(const void* phandle) {
   if (NULL == phandle) {
     LOGE(
@@ -86,6 +158,25 @@ int32_t uthread_close(const void* phandle) {
   return UTHREAD_SUCCESS;
 }
 
+int32_t uthread_release(const void* phandle) {
+  if (NULL == phandle) {
+    LOGE(
+        "Error: thread handle is null, please create a thread properly first!");
+    return UTHREAD_FAILURE;
+  }
+
+  // a prepared thread that was never started has no handle to close
+  DWORD ret = RET_SUCCESS;
+  if (NULL != ((thread_t*)phandle)->handle) {
+    ret = CloseHandle(((thread_t*)phandle)->handle);
+  }
+  free((void*)phandle);
+  if (RET_FAILURE == ret) {
+    return UTHREAD_FAILURE;
+  }
+  return UTHREAD_SUCCESS;
+}
+
 int32_t uthread_id_get(const void* phandle, uint64_t* pthread_id) {
   if (NULL == phandle) {
     LOGE(
@@ -101,6 +192,39 @@ int32_t uthread_id_get(const void* phandle, uint64_t* pthread_id) {
   return UTHREAD_SUCCESS;
 }
 
+int32_t uthread_priority_set(const void* phandle, int32_t policy,
+                             int32_t priority) {
+  // a null handle stands for the calling thread
+  HANDLE thread = phandle ? ((thread_t*)phandle)->handle : GetCurrentThread();
+
+  DWORD ret = SetThreadPriority(thread, priority_level(policy, priority));
+  if (RET_FAILURE == ret) {
+    LOGE("Error: failed to set the thread priority!");
+    return UTHREAD_FAILURE;
+  }
+  return UTHREAD_SUCCESS;
+}
+
+int32_t uthread_priority_get(const void* phandle, int32_t* ppolicy,
+                             int32_t* ppriority) {
+  if (NULL == ppolicy || NULL == ppriority) {
+    LOGE("Error: please pass valid policy and priority pointers!");
+    return UTHREAD_FAILURE;
+  }
+
+  HANDLE thread = phandle ? ((thread_t*)phandle)->handle : GetCurrentThread();
+  int    level  = GetThreadPriority(thread);
+  if (THREAD_PRIORITY_ERROR_RETURN == level) {
+    LOGE("Error: failed to get the thread priority!");
+    return UTHREAD_FAILURE;
+  }
+
+  *ppolicy   = level > THREAD_PRIORITY_NORMAL ? UTHREAD_SCHED_FIFO
+                                              : UTHREAD_SCHED_OTHER;
+  *ppriority = level;
+  return UTHREAD_SUCCESS;
+}
+
 int32_t uthread_sleep(uint64_t microseconds) {
   Sleep((DWORD)microseconds);
 
@@ -126,6 +250,11 @@ int32_t uthread_mutex_init(void** pplock) {
   return UTHREAD_SUCCESS;
 }
 
+int32_t uthread_mutex_init_ex(void** pplock, const void* pattr) {
+  // Windows mutex objects have no priority protocol to select
+  return uthread_mutex_init(pplock);
+}
+
 int32_t uthread_mutex_deinit(const void* plock) {
   if (NULL == plock) {
     LOGE("Error: mutex handle is null!");